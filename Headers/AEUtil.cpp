@@ -28,12 +28,86 @@ string getResourcesPath(PF_InData* in_data) {
 #endif
 }
 
-PF_Err setParamVisibility(AEGP_PluginID aegpId,
-                          PF_InData* in_data,
-                          PF_ParamDef* params[],
-                          PF_ParamIndex index,
-                          A_Boolean visible) {
-  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
+EffectStreams::EffectStreams(AEGP_PluginID aegpId, PF_InData* in_data) : _aegpId(aegpId), _in_data(in_data) {}
+
+EffectStreams::~EffectStreams() {
+  AEGP_SuiteHandler suites(_in_data->pica_basicP);
+
+  for (auto& stream : _paramStreams) {
+    suites.StreamSuite5()->AEGP_DisposeStream(stream.second);
+  }
+
+  if (_effectStreamH) {
+    suites.StreamSuite5()->AEGP_DisposeStream(_effectStreamH);
+  }
+
+  if (_effectH) {
+    suites.EffectSuite4()->AEGP_DisposeEffect(_effectH);
+  }
+}
+
+PF_Err EffectStreams::_getEffect(AEGP_EffectRefH* effectH) {
+  PF_Err err = PF_Err_NONE;
+
+  if (!_effectH) {
+    AEGP_SuiteHandler suites(_in_data->pica_basicP);
+    ERR(suites.PFInterfaceSuite1()->AEGP_GetNewEffectForEffect(_aegpId, _in_data->effect_ref, &_effectH));
+    _numSuiteCalls++;
+  }
+
+  *effectH = _effectH;
+
+  return err;
+}
+
+PF_Err EffectStreams::getParamStream(PF_ParamIndex index, AEGP_StreamRefH* streamH) {
+  PF_Err err = PF_Err_NONE;
+
+  auto it = _paramStreams.find(index);
+
+  if (it != _paramStreams.end()) {
+    *streamH = it->second;
+    return err;
+  }
+
+  AEGP_SuiteHandler suites(_in_data->pica_basicP);
+  AEGP_EffectRefH effectH = nullptr;
+
+  *streamH = nullptr;
+
+  ERR(_getEffect(&effectH));
+  ERR(suites.StreamSuite5()->AEGP_GetNewEffectStreamByIndex(_aegpId, effectH, index, streamH));
+  _numSuiteCalls++;
+
+  if (!err && *streamH) {
+    _paramStreams[index] = *streamH;
+  }
+
+  return err;
+}
+
+PF_Err EffectStreams::getEffectStream(AEGP_StreamRefH* streamH) {
+  PF_Err err = PF_Err_NONE;
+
+  if (!_effectStreamH) {
+    AEGP_SuiteHandler suites(_in_data->pica_basicP);
+
+    // https://ae-plugins.docsforadobe.dev/aegps/aegp-suites.html#streamrefs-and-effectrefs
+    // Assumes the effect has at least one parameter whose index is 1.
+    AEGP_StreamRefH firstParamH = nullptr;
+
+    ERR(getParamStream(1, &firstParamH));
+    ERR(suites.DynamicStreamSuite4()->AEGP_GetNewParentStreamRef(_aegpId, firstParamH, &_effectStreamH));
+    _numSuiteCalls++;
+  }
+
+  *streamH = _effectStreamH;
+
+  return err;
+}
+
+PF_Err setParamVisibility(EffectStreams& streams, PF_InData* in_data, PF_ParamDef* params[], PF_ParamIndex index, A_Boolean visible) {
+  PF_Err err = PF_Err_NONE;
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
   A_Boolean invisible = !visible;
@@ -48,24 +122,16 @@ PF_Err setParamVisibility(AEGP_PluginID aegpId,
   ERR(suites.ParamUtilsSuite3()->PF_UpdateParamUI(in_data->effect_ref, index, &newParam));
 
   // For After Effects
-  AEGP_EffectRefH effectH = nullptr;
   AEGP_StreamRefH streamH = nullptr;
 
-  ERR(suites.PFInterfaceSuite1()->AEGP_GetNewEffectForEffect(aegpId, in_data->effect_ref, &effectH));
-
-  ERR(suites.StreamSuite5()->AEGP_GetNewEffectStreamByIndex(aegpId, effectH, index, &streamH));
+  ERR(streams.getParamStream(index, &streamH));
 
   ERR(suites.DynamicStreamSuite4()->AEGP_SetDynamicStreamFlag(streamH, AEGP_DynStreamFlag_HIDDEN, FALSE, invisible));
 
-  if (effectH)
-    ERR2(suites.EffectSuite4()->AEGP_DisposeEffect(effectH));
-  if (streamH)
-    ERR2(suites.StreamSuite5()->AEGP_DisposeStream(streamH));
-
   return err;
 }
 
-PF_Err setParamName(AEGP_PluginID aegpId,
+PF_Err setParamName(EffectStreams& streams,
                     PF_InData* in_data,
                     PF_ParamDef* params[],
                     PF_ParamIndex index,
@@ -74,11 +140,9 @@ PF_Err setParamName(AEGP_PluginID aegpId,
 
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
-  // AEGP_EffectRefH effectH = nullptr;
   // AEGP_StreamRefH streamH = nullptr;
 
-  // ERR(suites.PFInterfaceSuite1()->AEGP_GetNewEffectForEffect(aegpId, in_data->effect_ref, &effectH));
-  // ERR(suites.StreamSuite5()->AEGP_GetNewEffectStreamByIndex(aegpId, effectH, index, &streamH));
+  // ERR(streams.getParamStream(index, &streamH));
 
   // A_UTF16Char* utf16Name;
 
@@ -206,53 +270,28 @@ PF_Err getColorParam(PF_InData* in_data, PF_OutData* out_data, int paramIndex, P
   return err;
 }
 
-static PF_Err getAEGPEffectStream(AEGP_PluginID aegpId, PF_InData* in_data, AEGP_StreamRefH* effectStreamH) {
-  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
-  AEGP_SuiteHandler suites(in_data->pica_basicP);
-
-  // https://ae-plugins.docsforadobe.dev/aegps/aegp-suites.html#streamrefs-and-effectrefs
-  AEGP_EffectRefH effectH = nullptr;
-  AEGP_StreamRefH firstParamH = nullptr;
-
-  ERR(suites.PFInterfaceSuite1()->AEGP_GetNewEffectForEffect(aegpId, in_data->effect_ref, &effectH));
-
-  // Assumes the effect has at least one parameter whose index is 1.
-  ERR(suites.StreamSuite5()->AEGP_GetNewEffectStreamByIndex(aegpId, effectH, 1, &firstParamH));
-
-  ERR(suites.DynamicStreamSuite4()->AEGP_GetNewParentStreamRef(aegpId, firstParamH, effectStreamH));
-
-  if (effectH)
-    ERR2(suites.EffectSuite4()->AEGP_DisposeEffect(effectH));
-  if (firstParamH)
-    ERR2(suites.StreamSuite5()->AEGP_DisposeStream(firstParamH));
-
-  return err;
-}
-
 PF_Err getEffectName(AEGP_PluginID aegpId, PF_InData* in_data, string* name) {
-  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
+  PF_Err err = PF_Err_NONE;
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
+  EffectStreams streams(aegpId, in_data);
   AEGP_StreamRefH effectStreamH = nullptr;
-  ERR(getAEGPEffectStream(aegpId, in_data, &effectStreamH));
+  ERR(streams.getEffectStream(&effectStreamH));
 
   A_char effectName[AEGP_MAX_ITEM_NAME_SIZE];
   ERR(suites.StreamSuite2()->AEGP_GetStreamName(effectStreamH, FALSE, effectName));
 
   *name = string(effectName);
 
-  if (effectStreamH)
-    ERR2(suites.StreamSuite5()->AEGP_DisposeStream(effectStreamH));
-
   return err;
 }
 
-PF_Err setEffectName(AEGP_PluginID aegpId, PF_InData* in_data, const string& name) {
-  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
+PF_Err setEffectName(EffectStreams& streams, PF_InData* in_data, const string& name) {
+  PF_Err err = PF_Err_NONE;
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
   AEGP_StreamRefH effectStreamH = nullptr;
-  ERR(getAEGPEffectStream(aegpId, in_data, &effectStreamH));
+  ERR(streams.getEffectStream(&effectStreamH));
 
   A_UTF16Char* utf16Name;
 
@@ -263,8 +302,33 @@ PF_Err setEffectName(AEGP_PluginID aegpId, PF_InData* in_data, const string& nam
 
   ERR(suites.DynamicStreamSuite4()->AEGP_SetStreamName(effectStreamH, utf16Name));
 
-  if (effectStreamH)
-    ERR2(suites.StreamSuite5()->AEGP_DisposeStream(effectStreamH));
+  return err;
+}
+
+PF_Err isParamTimeVarying(AEGP_PluginID aegpId, PF_InData* in_data, PF_ParamIndex index, A_Boolean* timeVarying) {
+  EffectStreams streams(aegpId, in_data);
+  return isParamTimeVarying(streams, in_data, index, timeVarying);
+}
+
+/**
+ * Tells if the value of the parameter may change over time, either by keyframes or an expression.
+ */
+PF_Err isParamTimeVarying(EffectStreams& streams, PF_InData* in_data, PF_ParamIndex index, A_Boolean* timeVarying) {
+  PF_Err err = PF_Err_NONE;
+  AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+  AEGP_StreamRefH streamH = nullptr;
+  A_Boolean hasExpression = FALSE;
+
+  *timeVarying = TRUE;
+
+  ERR(streams.getParamStream(index, &streamH));
+  ERR(suites.StreamSuite5()->AEGP_IsStreamTimevarying(streamH, timeVarying));
+  ERR(suites.StreamSuite5()->AEGP_GetExpressionState(streams.aegpId(), streamH, &hasExpression));
+
+  if (!err && hasExpression) {
+    *timeVarying = TRUE;
+  }
 
   return err;
 }
@@ -3,6 +3,7 @@
 #include "AE_Effect.h"
 
 #include <string>
+#include <unordered_map>
 
 #include "AEFX_SuiteHelper.h"
 #include "AEGP_SuiteHandler.h"
@@ -14,13 +15,41 @@ namespace AEUtil {
 
 string getResourcesPath(PF_InData* in_data);
 
-PF_Err setParamVisibility(AEGP_PluginID aegpId,
-                          PF_InData* in_data,
-                          PF_ParamDef* params[],
-                          PF_ParamIndex index,
-                          A_Boolean visible);
+/**
+ * Resolves the AEGP effect of the instance once and caches the streams of its parameters, so that a command changing
+ * many parameters doesn't acquire and dispose them for each change. They're acquired lazily and disposed on destruction,
+ * thus it must not outlive the command.
+ */
+class EffectStreams {
+ public:
+  EffectStreams(AEGP_PluginID aegpId, PF_InData* in_data);
+  ~EffectStreams();
 
-PF_Err setParamName(AEGP_PluginID aegpId, PF_InData* in_data, PF_ParamDef* params[], PF_ParamIndex index, string& name);
+  EffectStreams(const EffectStreams&) = delete;
+  EffectStreams& operator=(const EffectStreams&) = delete;
+
+  PF_Err getParamStream(PF_ParamIndex index, AEGP_StreamRefH* streamH);
+  PF_Err getEffectStream(AEGP_StreamRefH* streamH);
+
+  AEGP_PluginID aegpId() const { return _aegpId; }
+
+  // The number of AEGP calls made to acquire the effect and the streams, which are disposed once on destruction.
+  int numSuiteCalls() const { return _numSuiteCalls; }
+
+ private:
+  AEGP_PluginID _aegpId;
+  PF_InData* _in_data;
+  AEGP_EffectRefH _effectH = nullptr;
+  AEGP_StreamRefH _effectStreamH = nullptr;
+  unordered_map<PF_ParamIndex, AEGP_StreamRefH> _paramStreams;
+  int _numSuiteCalls = 0;
+
+  PF_Err _getEffect(AEGP_EffectRefH* effectH);
+};
+
+PF_Err setParamVisibility(EffectStreams& streams, PF_InData* in_data, PF_ParamDef* params[], PF_ParamIndex index, A_Boolean visible);
+
+PF_Err setParamName(EffectStreams& streams, PF_InData* in_data, PF_ParamDef* params[], PF_ParamIndex index, string& name);
 
 // Getters for parameters
 PF_Err getPointParam(PF_InData* in_data, PF_OutData* out_data, int paramId, A_FloatPoint* value);
@@ -32,7 +61,9 @@ PF_Err getColorParam(PF_InData* in_data, PF_OutData* out_data, int paramIndex, P
 
 // AEGP utils
 PF_Err getEffectName(AEGP_PluginID aegpId, PF_InData* in_data, string* name);
-PF_Err setEffectName(AEGP_PluginID aegpId, PF_InData* in_data, const string& name);
+PF_Err setEffectName(EffectStreams& streams, PF_InData* in_data, const string& name);
+PF_Err isParamTimeVarying(AEGP_PluginID aegpId, PF_InData* in_data, PF_ParamIndex index, A_Boolean* timeVarying);
+PF_Err isParamTimeVarying(EffectStreams& streams, PF_InData* in_data, PF_ParamIndex index, A_Boolean* timeVarying);
 
 PF_Err getStringPersistentData(PF_InData* in_data,
                                const A_char* sectionKey,
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Watches the modification times of files on a background thread, and counts up the version of each file whenever it's
+ * modified, created or deleted. It polls instead of using the notification APIs of each OS, which is fast enough for a
+ * handful of shader files and works the same on every platform.
+ */
+class FileWatcher {
+ private:
+  struct File {
+    filesystem::file_time_type time;
+    bool exists = false;
+    uint64_t version = 0;
+  };
+
+  chrono::milliseconds _interval;
+  unordered_map<string, File> _files;
+  mutex _mutex;
+  condition_variable _stopRequested;
+  bool _stopping = false;
+  thread _thread;
+
+  static File _stat(const string& path) {
+    File file;
+    error_code ec;
+
+    file.time = filesystem::last_write_time(path, ec);
+    file.exists = !ec;
+
+    return file;
+  }
+
+  void _poll() {
+    unique_lock<mutex> lock(_mutex);
+
+    while (!_stopRequested.wait_for(lock, _interval, [this] { return _stopping; })) {
+      vector<string> paths;
+      for (auto& file : _files) {
+        paths.push_back(file.first);
+      }
+
+      // Don't block watch() and getVersion() while accessing the file system
+      lock.unlock();
+
+      vector<File> stats;
+      for (auto& path : paths) {
+        stats.push_back(_stat(path));
+      }
+
+      lock.lock();
+
+      for (size_t i = 0; i < paths.size(); i++) {
+        auto& file = _files[paths[i]];
+
+        if (file.exists != stats[i].exists || file.time != stats[i].time) {
+          file.time = stats[i].time;
+          file.exists = stats[i].exists;
+          file.version++;
+        }
+      }
+    }
+  }
+
+ public:
+  FileWatcher(chrono::milliseconds interval) : _interval(interval) { _thread = thread([this] { _poll(); }); }
+
+  ~FileWatcher() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _stopping = true;
+    }
+
+    _stopRequested.notify_all();
+    _thread.join();
+  }
+
+  /**
+   * Starts watching the file unless already watched, and returns its current version. The file doesn't have to exist.
+   */
+  uint64_t watch(const string& path) {
+    lock_guard<mutex> lock(_mutex);
+
+    auto it = _files.find(path);
+
+    if (it == _files.end()) {
+      it = _files.emplace(path, _stat(path)).first;
+    }
+
+    return it->second.version;
+  }
+
+  /**
+   * Returns the number of times the file has been changed since it started to be watched, or 0 if not watched.
+   */
+  uint64_t getVersion(const string& path) {
+    lock_guard<mutex> lock(_mutex);
+
+    auto it = _files.find(path);
+
+    return it != _files.end() ? it->second.version : 0;
+  }
+};
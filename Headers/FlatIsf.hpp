@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Hash.hpp"
+#include "LZ.hpp"
+
+using namespace std;
+
+#define ARB_ISF_FLAT_V1_MAGIC_NUMBER 0x01
+
+struct ParamArbIsfFlatV1 {
+  uint8_t magicNumber;  // Always should be set to ARB_ISF_FLAT_V1_MAGIC_NUMBER
+  uint32_t version;
+  uint32_t offsetName;
+  uint32_t offsetFragCode;
+  uint32_t offsetVertCode;
+};
+
+#define ARB_ISF_FLAT_V2_MAGIC_NUMBER 0x02
+
+// The fragment and vertex codes are concatenated and compressed by LZ::compress(), and placed after the name.
+struct ParamArbIsfFlatV2 {
+  uint8_t magicNumber;  // Always should be set to ARB_ISF_FLAT_V2_MAGIC_NUMBER
+  uint32_t version;
+  uint32_t offsetName;
+  uint32_t offsetCode;
+  uint32_t fragCodeSize;
+  uint32_t vertCodeSize;
+  // The digest of the codes, which finds the cached shader without decompressing them.
+  Digest128 digest;
+};
+
+/**
+ * Computes the digest identifying the pair of fragment and vertex shader sources.
+ */
+inline Digest128 getSourceDigest(const string& fsCode, const string& vsCode) {
+  Hasher hasher;
+  hasher.update(fsCode);
+  hasher.update(vsCode);
+
+  return hasher.digest128();
+}
+
+/**
+ * Reads and writes the ISF parameter flattened into the project, without depending on AE so that the parsing can be
+ * fuzzed and measured alone.
+ */
+namespace FlatIsf {
+
+struct Data {
+  string name;
+  // Both are empty when no shader is loaded, or when the shader is found by the digest without decompressing them.
+  string fsCode, vsCode;
+  // Only saved by V2.
+  Digest128 digest;
+  bool isCached = false;
+};
+
+/**
+ * Each version checks every size and offset against the size of the buffer, since a project saved partially such as a
+ * truncated autosave may have any bytes. They return false if the data is invalid.
+ */
+inline bool _parseV0(const char* data, size_t size, Data* out) {
+  // Find an offset of '\0' to split name and code
+  auto* nameEnd = reinterpret_cast<const char*>(memchr(data, '\0', size));
+
+  if (!nameEnd) {
+    return false;
+  }
+
+  size_t nameSize = nameEnd - data;
+
+  out->name = string(data, nameSize);
+  out->fsCode = string(data + nameSize + 1, size - (nameSize + 1));
+
+  return true;
+}
+
+inline bool _parseV1(const char* data, size_t size, Data* out) {
+  if (size < sizeof(ParamArbIsfFlatV1)) {
+    return false;
+  }
+
+  ParamArbIsfFlatV1 header;
+  memcpy(&header, data, sizeof(ParamArbIsfFlatV1));
+
+  if (header.offsetName < sizeof(ParamArbIsfFlatV1) || header.offsetFragCode < header.offsetName ||
+      header.offsetVertCode < header.offsetFragCode || size < header.offsetVertCode) {
+    return false;
+  }
+
+  out->name = string(data + header.offsetName, header.offsetFragCode - header.offsetName);
+  out->fsCode = string(data + header.offsetFragCode, header.offsetVertCode - header.offsetFragCode);
+  out->vsCode = string(data + header.offsetVertCode, size - header.offsetVertCode);
+
+  return true;
+}
+
+inline bool _parseV2(const char* data, size_t size, Data* out, const function<bool(const Digest128&)>& isCached) {
+  if (size < sizeof(ParamArbIsfFlatV2)) {
+    return false;
+  }
+
+  ParamArbIsfFlatV2 header;
+  memcpy(&header, data, sizeof(ParamArbIsfFlatV2));
+
+  if (header.offsetName < sizeof(ParamArbIsfFlatV2) || header.offsetCode < header.offsetName || size < header.offsetCode) {
+    return false;
+  }
+
+  out->name = string(data + header.offsetName, header.offsetCode - header.offsetName);
+  out->digest = header.digest;
+
+  // An instance without any shader loaded is saved with empty codes and without their digest
+  if (header.fragCodeSize == 0 && header.vertCodeSize == 0) {
+    return true;
+  }
+
+  // The instances sharing a shader, or reopening a project in the same session, skip decompressing the codes
+  if (isCached && isCached(header.digest)) {
+    out->isCached = true;
+    return true;
+  }
+
+  // Reject the sizes the compressed codes can never expand to, before allocating for them
+  const char* compressed = data + header.offsetCode;
+  size_t compressedSize = size - header.offsetCode;
+  uint64_t codeSize = (uint64_t)header.fragCodeSize + header.vertCodeSize;
+
+  if (codeSize > LZ::maxDecompressedSize(compressedSize)) {
+    return false;
+  }
+
+  string code(codeSize, '\0');
+
+  if (!LZ::decompress(compressed, compressedSize, &code[0], code.size())) {
+    return false;
+  }
+
+  out->fsCode = code.substr(0, header.fragCodeSize);
+  out->vsCode = code.substr(header.fragCodeSize);
+
+  return getSourceDigest(out->fsCode, out->vsCode) == header.digest;
+}
+
+/**
+ * Parses the flattened parameter of any version. isCached is asked whether the shader of the digest is already loaded,
+ * in which case the codes are left empty without decompressing them. Returns false if the data is invalid, and the data
+ * parsed partially should be discarded.
+ */
+inline bool parse(const char* data, size_t size, Data* out, const function<bool(const Digest128&)>& isCached = nullptr) {
+  if (!data || size == 0) {
+    return false;
+  }
+
+  switch (data[0]) {
+    case ARB_ISF_FLAT_V2_MAGIC_NUMBER:
+      return _parseV2(data, size, out, isCached);
+    case ARB_ISF_FLAT_V1_MAGIC_NUMBER:
+      return _parseV1(data, size, out);
+    default:
+      // Means version 0
+      return _parseV0(data, size, out);
+  }
+}
+
+/**
+ * Returns the size of the data written by writeV2().
+ */
+inline size_t getV2Size(const string& name, const vector<char>& compressedCode) {
+  return sizeof(ParamArbIsfFlatV2) + name.size() + compressedCode.size();
+}
+
+/**
+ * Writes the parameter in V2 into the buffer of getV2Size(). The codes are given compressed by LZ::compress() so that
+ * they can be compressed once and written many times.
+ */
+inline void writeV2(char* dst,
+                    const string& name,
+                    const vector<char>& compressedCode,
+                    size_t fragCodeSize,
+                    size_t vertCodeSize,
+                    const Digest128& digest) {
+  ParamArbIsfFlatV2 header;
+  memset(static_cast<void*>(&header), 0, sizeof(header));
+
+  header.magicNumber = ARB_ISF_FLAT_V2_MAGIC_NUMBER;
+  header.version = 2;
+  header.offsetName = sizeof(ParamArbIsfFlatV2);
+  header.offsetCode = header.offsetName + (uint32_t)name.size();
+  header.fragCodeSize = (uint32_t)fragCodeSize;
+  header.vertCodeSize = (uint32_t)vertCodeSize;
+  header.digest = digest;
+
+  // The buffer given by AE isn't guaranteed to be aligned for the digest
+  memcpy(dst, &header, sizeof(ParamArbIsfFlatV2));
+  memcpy(dst + header.offsetName, name.data(), name.size());
+  memcpy(dst + header.offsetCode, compressedCode.data(), compressedCode.size());
+}
+
+}  // namespace FlatIsf
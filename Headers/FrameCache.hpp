@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A thread-safe cache of rendered frames keyed by a digest of everything that the pixels depend on. When the total size
+ * of the frames exceeds the budget, the least recently used ones are evicted.
+ */
+class FrameCache {
+ public:
+  struct Frame {
+    size_t bytesPerRow = 0;
+    size_t height = 0;
+    vector<char> pixels;
+  };
+
+ private:
+  using Entry = pair<uint64_t, shared_ptr<const Frame>>;
+
+  size_t _budget;
+  size_t _size = 0;
+  // The most recently used frame comes first.
+  list<Entry> _entries;
+  unordered_map<uint64_t, list<Entry>::iterator> _index;
+  mutex _mutex;
+  atomic<size_t> _hits{0}, _misses{0};
+
+  void _evictToFit(size_t budget) {
+    while (_size > budget && !_entries.empty()) {
+      auto& last = _entries.back();
+      _size -= last.second->pixels.size();
+      _index.erase(last.first);
+      _entries.pop_back();
+    }
+  }
+
+ public:
+  FrameCache(size_t budget) : _budget(budget) {}
+
+  /**
+   * Returns the frame and marks it as the most recently used one, or nullptr if not cached.
+   */
+  shared_ptr<const Frame> get(uint64_t key) {
+    lock_guard<mutex> lock(_mutex);
+
+    auto it = _index.find(key);
+
+    if (it == _index.end()) {
+      _misses++;
+      return nullptr;
+    }
+
+    _hits++;
+    _entries.splice(_entries.begin(), _entries, it->second);
+
+    return it->second->second;
+  }
+
+  /**
+   * Stores the frame unless it's larger than the whole budget.
+   */
+  void set(uint64_t key, const shared_ptr<const Frame>& frame) {
+    size_t frameSize = frame->pixels.size();
+
+    if (frameSize > _budget) {
+      return;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+
+    auto it = _index.find(key);
+
+    if (it != _index.end()) {
+      _size -= it->second->second->pixels.size();
+      _entries.erase(it->second);
+      _index.erase(it);
+    }
+
+    _evictToFit(_budget - frameSize);
+
+    _entries.emplace_front(key, frame);
+    _index[key] = _entries.begin();
+    _size += frameSize;
+  }
+
+  void clear() {
+    lock_guard<mutex> lock(_mutex);
+    _evictToFit(0);
+  }
+
+  size_t hits() const { return _hits; }
+
+  size_t misses() const { return _misses; }
+
+  // The total bytes of the cached pixels.
+  size_t size() {
+    lock_guard<mutex> lock(_mutex);
+    return _size;
+  }
+
+  size_t budget() const { return _budget; }
+};
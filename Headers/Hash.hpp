@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+using namespace std;
+
+/**
+ * A 128-bit digest, which is long enough to identify contents such as shader sources without comparing them.
+ */
+struct Digest128 {
+  uint64_t high = 0;
+  uint64_t low = 0;
+
+  bool operator==(const Digest128& other) const { return high == other.high && low == other.low; }
+  bool operator!=(const Digest128& other) const { return !(*this == other); }
+};
+
+struct Digest128Hash {
+  size_t operator()(const Digest128& digest) const { return (size_t)(digest.low ^ (digest.high * 0x9E3779B97F4A7C15ULL)); }
+};
+
+/**
+ * A fast non-cryptographic hash for building cache keys, with the same rounds as XXH64. The input is fed by update()
+ * calls, and the digest depends on how it's split into the calls as well as the bytes themselves. The 128-bit digest is
+ * made by finalizing the state twice with different seeds.
+ */
+class Hasher {
+ private:
+  static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+  static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+  static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+  static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+  static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+  uint64_t _lanes[4] = {Prime1 + Prime2, Prime2, 0, 0 - Prime1};
+  uint64_t _tail = Prime5;
+  uint64_t _length = 0;
+
+  static uint64_t _rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  static uint64_t _round(uint64_t acc, uint64_t input) { return _rotl(acc + input * Prime2, 31) * Prime1; }
+
+  static uint64_t _read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  uint64_t _finalize(uint64_t seed) const {
+    uint64_t h = seed + _rotl(_lanes[0], 1) + _rotl(_lanes[1], 7) + _rotl(_lanes[2], 12) + _rotl(_lanes[3], 18);
+
+    for (auto lane : _lanes) {
+      h = (h ^ _round(seed, lane)) * Prime1 + Prime4;
+    }
+
+    h ^= _tail;
+    h += _length;
+
+    // Avalanche
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+
+    return h;
+  }
+
+ public:
+  Hasher& update(const void* data, size_t size) {
+    auto* p = reinterpret_cast<const uint8_t*>(data);
+    _length += size;
+
+    // Four independent lanes so that the multiplications can run in parallel
+    for (; size >= 32; p += 32, size -= 32) {
+      _lanes[0] = _round(_lanes[0], _read64(p));
+      _lanes[1] = _round(_lanes[1], _read64(p + 8));
+      _lanes[2] = _round(_lanes[2], _read64(p + 16));
+      _lanes[3] = _round(_lanes[3], _read64(p + 24));
+    }
+
+    for (; size >= 8; p += 8, size -= 8) {
+      _tail = _rotl(_tail ^ _round(0, _read64(p)), 27) * Prime1 + Prime4;
+    }
+
+    if (size > 0) {
+      uint64_t rest = 0;
+      memcpy(&rest, p, size);
+      _tail = _rotl(_tail ^ (rest * Prime5), 11) * Prime1;
+    }
+
+    return *this;
+  }
+
+  Hasher& update(const string& str) {
+    uint64_t size = str.size();
+    update(&size, sizeof(size));
+    return update(str.data(), str.size());
+  }
+
+  template <typename T>
+  Hasher& add(const T& value) {
+    static_assert(is_trivially_copyable<T>::value, "Only trivially copyable values can be hashed by their bytes");
+    return update(&value, sizeof(value));
+  }
+
+  uint64_t digest() const { return _finalize(0); }
+
+  Digest128 digest128() const {
+    Digest128 digest;
+    digest.high = _finalize(Prime3);
+    digest.low = _finalize(0);
+    return digest;
+  }
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A thread-safe cache that evicts the least recently used values when the sum of their estimated sizes exceeds the
+ * budget. Values still referenced outside of the cache are pinned and never evicted, so a value can be looked up again
+ * as long as anyone holds it. The keys are split into shards with their own locks and budgets, so that lookups of
+ * different keys rarely wait for each other.
+ *
+ * Lookups are the common case, so they only take the shard's lock shared and stamp the entry with an atomic clock
+ * instead of reordering a list. The eviction pays for it instead, sorting the unpinned entries by the stamps only when
+ * the shard is over its budget. The size of each value is estimated when it's set and summed up as it goes, and since the
+ * sizes may change while values are in use, they're re-estimated when the running total goes over the budget and by
+ * trim().
+ */
+template <class K, class V, class Hash = hash<K>>
+class LRUCache {
+ private:
+  struct Entry {
+    shared_ptr<V> value;
+    size_t size = 0;
+    atomic<uint64_t> lastUsed{0};
+  };
+
+  struct Shard {
+    unordered_map<K, Entry, Hash> entries;
+    // The sum of the sizes of the entries.
+    size_t bytes = 0;
+    atomic<uint64_t> clock{0};
+    // The values being created by getOrCreate(), which the other callers for the same key wait for.
+    unordered_map<K, shared_future<shared_ptr<V>>, Hash> inFlight;
+    shared_mutex entriesMutex;
+  };
+
+  function<size_t(const V&)> _sizeOf;
+  size_t _shardBudget;
+  vector<unique_ptr<Shard>> _shards;
+
+  static bool _isPinned(const Entry& entry) { return entry.value.use_count() > 1; }
+
+  Shard& _getShard(const K& key) {
+    size_t h = Hash()(key);
+    return *_shards[(h ^ (h >> 17)) % _shards.size()];
+  }
+
+  // Can be called while the shard is locked shared.
+  static shared_ptr<V> _touch(Shard& shard, Entry& entry) {
+    entry.lastUsed.store(++shard.clock, memory_order_relaxed);
+    return entry.value;
+  }
+
+  // Must be called while the shard is locked exclusively.
+  void _reestimate(Shard& shard) {
+    shard.bytes = 0;
+
+    for (auto& [key, entry] : shard.entries) {
+      entry.size = _sizeOf(*entry.value);
+      shard.bytes += entry.size;
+    }
+  }
+
+  // Must be called while the shard is locked exclusively.
+  void _evict(Shard& shard) {
+    if (shard.bytes <= _shardBudget) {
+      return;
+    }
+
+    vector<pair<uint64_t, const K*>> unpinned;
+
+    for (auto& [key, entry] : shard.entries) {
+      if (!_isPinned(entry)) {
+        unpinned.emplace_back(entry.lastUsed.load(memory_order_relaxed), &key);
+      }
+    }
+
+    sort(unpinned.begin(), unpinned.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (auto& [lastUsed, key] : unpinned) {
+      if (shard.bytes <= _shardBudget) {
+        break;
+      }
+
+      auto it = shard.entries.find(*key);
+      shard.bytes -= it->second.size;
+      shard.entries.erase(it);
+    }
+  }
+
+  // Must be called while the shard is locked exclusively.
+  void _set(Shard& shard, const K& key, const shared_ptr<V>& value) {
+    auto& entry = shard.entries[key];
+
+    shard.bytes -= entry.size;
+    entry.value = value;
+    entry.size = _sizeOf(*value);
+    shard.bytes += entry.size;
+    _touch(shard, entry);
+
+    if (shard.bytes > _shardBudget) {
+      _reestimate(shard);
+      _evict(shard);
+    }
+  }
+
+ public:
+  LRUCache(const function<size_t(const V&)>& sizeOf, size_t budget, size_t numShards = 8) : _sizeOf(sizeOf) {
+    numShards = numShards > 0 ? numShards : 1;
+    _shardBudget = budget / numShards;
+
+    for (size_t i = 0; i < numShards; i++) {
+      _shards.push_back(make_unique<Shard>());
+    }
+  }
+
+  /**
+   * Returns the value and marks it as the most recently used one, or nullptr if not cached.
+   */
+  shared_ptr<V> get(const K& key) {
+    auto& shard = _getShard(key);
+    shared_lock<shared_mutex> lock(shard.entriesMutex);
+
+    auto it = shard.entries.find(key);
+
+    if (it == shard.entries.end()) {
+      return nullptr;
+    }
+
+    return _touch(shard, it->second);
+  };
+
+  void set(const K& key, const shared_ptr<V>& value) {
+    auto& shard = _getShard(key);
+    unique_lock<shared_mutex> lock(shard.entriesMutex);
+
+    _set(shard, key, value);
+  };
+
+  /**
+   * Returns the cached value, or creates and caches it by the factory if not cached. The factory is called outside of the
+   * lock and only once for concurrent calls with the same key, which wait for its result. If the factory throws, the
+   * waiting callers get the same exception.
+   */
+  shared_ptr<V> getOrCreate(const K& key, const function<shared_ptr<V>()>& factory) {
+    if (auto value = get(key)) {
+      return value;
+    }
+
+    auto& shard = _getShard(key);
+    unique_lock<shared_mutex> lock(shard.entriesMutex);
+
+    // Created by another caller since the lookup above
+    auto it = shard.entries.find(key);
+
+    if (it != shard.entries.end()) {
+      return _touch(shard, it->second);
+    }
+
+    auto flight = shard.inFlight.find(key);
+
+    if (flight != shard.inFlight.end()) {
+      auto result = flight->second;
+      lock.unlock();
+      return result.get();
+    }
+
+    promise<shared_ptr<V>> flightPromise;
+    shard.inFlight[key] = flightPromise.get_future().share();
+    lock.unlock();
+
+    shared_ptr<V> value;
+
+    try {
+      value = factory();
+    } catch (...) {
+      lock.lock();
+      shard.inFlight.erase(key);
+      lock.unlock();
+
+      flightPromise.set_exception(current_exception());
+      throw;
+    }
+
+    lock.lock();
+    _set(shard, key, value);
+    shard.inFlight.erase(key);
+    lock.unlock();
+
+    flightPromise.set_value(value);
+
+    return value;
+  }
+
+  /**
+   * Re-estimates the sizes of the values, and evicts the unpinned ones until each shard fits in its budget.
+   */
+  void trim() {
+    for (auto& shard : _shards) {
+      unique_lock<shared_mutex> lock(shard->entriesMutex);
+      _reestimate(*shard);
+      _evict(*shard);
+    }
+  }
+
+  // The sum of the sizes of the cached values, as estimated when they were set or trimmed last.
+  size_t size() {
+    size_t size = 0;
+
+    for (auto& shard : _shards) {
+      shared_lock<shared_mutex> lock(shard->entriesMutex);
+      size += shard->bytes;
+    }
+
+    return size;
+  }
+
+  size_t count() {
+    size_t count = 0;
+
+    for (auto& shard : _shards) {
+      shared_lock<shared_mutex> lock(shard->entriesMutex);
+      count += shard->entries.size();
+    }
+
+    return count;
+  }
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A small LZ77 compressor in the same sequence layout as LZ4 blocks, fast enough to run on every flatten. Each sequence
+ * is a token whose upper and lower 4 bits are the number of literals and the match length minus 4, followed by the
+ * extra bytes of the literal length, the literals, a 16-bit little-endian offset and the extra bytes of the match
+ * length. The last sequence only has literals.
+ */
+namespace LZ {
+
+static const size_t MinMatch = 4;
+static const size_t MaxOffset = 65535;
+static const int HashBits = 14;
+
+inline uint32_t _read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t _hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - HashBits);
+}
+
+inline void _writeLength(vector<uint8_t>& dst, size_t length) {
+  for (; length >= 255; length -= 255) {
+    dst.push_back(255);
+  }
+  dst.push_back((uint8_t)length);
+}
+
+inline vector<char> compress(const char* data, size_t size) {
+  auto* src = reinterpret_cast<const uint8_t*>(data);
+  vector<uint8_t> dst;
+  dst.reserve(size / 2 + 16);
+
+  vector<uint32_t> table(1 << HashBits, 0);
+
+  size_t anchor = 0;
+  size_t i = 0;
+
+  // Leave the last bytes as literals so that a match never reads beyond the end
+  size_t matchLimit = size > MinMatch + 8 ? size - (MinMatch + 8) : 0;
+
+  while (i < matchLimit) {
+    uint32_t seq = _read32(src + i);
+    uint32_t h = _hash(seq);
+    size_t candidate = table[h];
+    table[h] = (uint32_t)i;
+
+    if (candidate >= i || i - candidate > MaxOffset || _read32(src + candidate) != seq) {
+      i++;
+      continue;
+    }
+
+    size_t matchLength = MinMatch;
+    while (i + matchLength < size && src[candidate + matchLength] == src[i + matchLength]) {
+      matchLength++;
+    }
+
+    size_t literalLength = i - anchor;
+    size_t tokenMatch = matchLength - MinMatch;
+
+    dst.push_back((uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4 | (tokenMatch >= 15 ? 15 : tokenMatch)));
+
+    if (literalLength >= 15) {
+      _writeLength(dst, literalLength - 15);
+    }
+
+    dst.insert(dst.end(), src + anchor, src + i);
+
+    size_t offset = i - candidate;
+    dst.push_back((uint8_t)(offset & 0xff));
+    dst.push_back((uint8_t)(offset >> 8));
+
+    if (tokenMatch >= 15) {
+      _writeLength(dst, tokenMatch - 15);
+    }
+
+    i += matchLength;
+    anchor = i;
+  }
+
+  size_t literalLength = size - anchor;
+  dst.push_back((uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4));
+
+  if (literalLength >= 15) {
+    _writeLength(dst, literalLength - 15);
+  }
+
+  dst.insert(dst.end(), src + anchor, src + size);
+
+  return vector<char>(dst.begin(), dst.end());
+}
+
+/**
+ * The largest size that the compressed data of the size can be decompressed into, as each byte of the data expands to
+ * 255 bytes at most. Used to reject corrupted sizes before allocating for them.
+ */
+inline uint64_t maxDecompressedSize(size_t size) {
+  return (uint64_t)size * 255;
+}
+
+/**
+ * Decompresses exactly dstSize bytes into dst. Returns false if the data is malformed or doesn't match the size, without
+ * reading or writing out of the buffers.
+ */
+inline bool decompress(const char* data, size_t size, char* dst, size_t dstSize) {
+  auto* src = reinterpret_cast<const uint8_t*>(data);
+  auto* out = reinterpret_cast<uint8_t*>(dst);
+  size_t i = 0, o = 0;
+
+  auto readLength = [&](size_t length, bool* ok) {
+    if (length < 15) {
+      return length;
+    }
+
+    uint8_t b;
+    do {
+      if (i >= size) {
+        *ok = false;
+        return length;
+      }
+      b = src[i++];
+      length += b;
+    } while (b == 255);
+
+    return length;
+  };
+
+  while (i < size) {
+    uint8_t token = src[i++];
+    bool ok = true;
+
+    size_t literalLength = readLength(token >> 4, &ok);
+
+    if (!ok || literalLength > size - i || literalLength > dstSize - o) {
+      return false;
+    }
+
+    memcpy(out + o, src + i, literalLength);
+    i += literalLength;
+    o += literalLength;
+
+    if (i == size) {
+      // The last sequence has no match
+      break;
+    }
+
+    if (size - i < 2) {
+      return false;
+    }
+
+    size_t offset = src[i] | (size_t)src[i + 1] << 8;
+    i += 2;
+
+    size_t matchLength = readLength(token & 0x0f, &ok) + MinMatch;
+
+    if (!ok || offset == 0 || offset > o || matchLength > dstSize - o) {
+      return false;
+    }
+
+    // Copy byte by byte since the match may overlap the bytes being written
+    for (size_t k = 0; k < matchLength; k++, o++) {
+      out[o] = out[o - offset];
+    }
+  }
+
+  return o == dstSize;
+}
+
+}  // namespace LZ
@@ -0,0 +1,294 @@
+#include "PixelConvert.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_CONVERT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXEL_CONVERT_TARGET(isa)
+#else
+#define PIXEL_CONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace PixelConvert {
+
+// The minimum number of rows converted by a single task, so that small images won't be split too finely.
+static const size_t MinRowsPerTask = 32;
+
+// The source channel for each destination channel.
+static const int AEToGLOrder[4] = {1, 2, 3, 0};  // ARGB -> RGBA
+static const int GLToAEOrder[4] = {3, 0, 1, 2};  // RGBA -> ARGB
+
+using RowKernel = void (*)(const uint8_t* src, uint8_t* dst, size_t width, short bitdepth, Direction direction, const uint8_t* mask);
+
+static inline uint16_t expand16(uint16_t v) {
+  // Equivalent to v * 0xffff / 0x8000 within an error of 0.5, and same as the SIMD variants
+  return (uint16_t)(min<uint32_t>(v * 2u, 0xffff) - ((v >> 14) & 1));
+}
+
+static inline uint16_t shrink16(uint16_t v) {
+  return (uint16_t)((v + 1u) >> 1);
+}
+
+template <typename T>
+static void convertPixels(const uint8_t* src, uint8_t* dst, size_t width, const int* order, bool expands, bool shrinks) {
+  for (size_t x = 0; x < width; x++) {
+    T in[4], out[4];
+    memcpy(in, src + x * sizeof(in), sizeof(in));
+
+    for (int c = 0; c < 4; c++) {
+      out[c] = in[order[c]];
+    }
+
+    if (sizeof(T) == 2) {
+      for (int c = 0; c < 4; c++) {
+        if (expands) {
+          out[c] = (T)expand16((uint16_t)out[c]);
+        } else if (shrinks) {
+          out[c] = (T)shrink16((uint16_t)out[c]);
+        }
+      }
+    }
+
+    memcpy(dst + x * sizeof(out), out, sizeof(out));
+  }
+}
+
+static void convertRowScalar(const uint8_t* src, uint8_t* dst, size_t width, short bitdepth, Direction direction, const uint8_t* /* mask */) {
+  const int* order = direction == AEToGL ? AEToGLOrder : GLToAEOrder;
+
+  switch (bitdepth) {
+    case 8:
+      convertPixels<uint8_t>(src, dst, width, order, false, false);
+      break;
+    case 16:
+      convertPixels<uint16_t>(src, dst, width, order, direction == AEToGL, direction == GLToAE);
+      break;
+    case 32:
+      convertPixels<float>(src, dst, width, order, false, false);
+      break;
+  }
+}
+
+/**
+ * Makes a byte shuffle mask for 32 bytes, which reorders the channels of every pixel in each 16 bytes.
+ */
+static void makeShuffleMask(uint8_t mask[32], short bitdepth, Direction direction) {
+  const int* order = direction == AEToGL ? AEToGLOrder : GLToAEOrder;
+  int channelBytes = bitdepth / 8;
+  int pixelBytes = channelBytes * 4;
+
+  for (int i = 0; i < 32; i++) {
+    int j = i % 16;
+    int pixel = j / pixelBytes;
+    int channel = (j % pixelBytes) / channelBytes;
+    int byte = j % channelBytes;
+
+    mask[i] = (uint8_t)(pixel * pixelBytes + order[channel] * channelBytes + byte);
+  }
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+PIXEL_CONVERT_TARGET("ssse3,sse4.1")
+static void convertRowSSE41(const uint8_t* src, uint8_t* dst, size_t width, short bitdepth, Direction direction, const uint8_t* mask) {
+  size_t pixelBytes = bitdepth / 2;
+  size_t bytes = width * pixelBytes;
+
+  __m128i shuffle = _mm_loadu_si128((const __m128i*)mask);
+  __m128i one = _mm_set1_epi16(1);
+  __m128i zero = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuffle);
+
+    if (bitdepth == 16) {
+      if (direction == AEToGL) {
+        v = _mm_subs_epu16(_mm_adds_epu16(v, v), _mm_and_si128(_mm_srli_epi16(v, 14), one));
+      } else {
+        v = _mm_avg_epu16(v, zero);
+      }
+    }
+
+    _mm_storeu_si128((__m128i*)(dst + i), v);
+  }
+
+  convertRowScalar(src + i, dst + i, (bytes - i) / pixelBytes, bitdepth, direction, mask);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void convertRowAVX2(const uint8_t* src, uint8_t* dst, size_t width, short bitdepth, Direction direction, const uint8_t* mask) {
+  size_t pixelBytes = bitdepth / 2;
+  size_t bytes = width * pixelBytes;
+
+  __m256i shuffle = _mm256_loadu_si256((const __m256i*)mask);
+  __m256i one = _mm256_set1_epi16(1);
+  __m256i zero = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src + i)), shuffle);
+
+    if (bitdepth == 16) {
+      if (direction == AEToGL) {
+        v = _mm256_subs_epu16(_mm256_adds_epu16(v, v), _mm256_and_si256(_mm256_srli_epi16(v, 14), one));
+      } else {
+        v = _mm256_avg_epu16(v, zero);
+      }
+    }
+
+    _mm256_storeu_si256((__m256i*)(dst + i), v);
+  }
+
+  convertRowScalar(src + i, dst + i, (bytes - i) / pixelBytes, bitdepth, direction, mask);
+}
+
+static bool cpuSupports(const char* isa) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  bool sse41 = (info[2] & (1 << 19)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+
+  if (strcmp(isa, "sse4.1") == 0) {
+    return sse41;
+  }
+
+  if (strcmp(isa, "avx2") == 0) {
+    if (maxLeaf < 7 || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+      return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  }
+
+  return false;
+#else
+  __builtin_cpu_init();
+
+  if (strcmp(isa, "sse4.1") == 0) {
+    return __builtin_cpu_supports("sse4.1");
+  }
+
+  if (strcmp(isa, "avx2") == 0) {
+    return __builtin_cpu_supports("avx2");
+  }
+
+  return false;
+#endif
+}
+
+#endif  // PIXEL_CONVERT_X86
+
+#ifdef PIXEL_CONVERT_NEON
+
+static void convertRowNEON(const uint8_t* src, uint8_t* dst, size_t width, short bitdepth, Direction direction, const uint8_t* mask) {
+  size_t pixelBytes = bitdepth / 2;
+  size_t bytes = width * pixelBytes;
+
+  uint8x16_t shuffle = vld1q_u8(mask);
+  uint16x8_t one = vdupq_n_u16(1);
+  uint16x8_t zero = vdupq_n_u16(0);
+
+  size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    uint8x16_t v = vqtbl1q_u8(vld1q_u8(src + i), shuffle);
+
+    if (bitdepth == 16) {
+      uint16x8_t w = vreinterpretq_u16_u8(v);
+
+      if (direction == AEToGL) {
+        w = vqsubq_u16(vqaddq_u16(w, w), vandq_u16(vshrq_n_u16(w, 14), one));
+      } else {
+        w = vrhaddq_u16(w, zero);
+      }
+
+      v = vreinterpretq_u8_u16(w);
+    }
+
+    vst1q_u8(dst + i, v);
+  }
+
+  convertRowScalar(src + i, dst + i, (bytes - i) / pixelBytes, bitdepth, direction, mask);
+}
+
+#endif  // PIXEL_CONVERT_NEON
+
+struct Kernel {
+  RowKernel convertRow;
+  const char* name;
+};
+
+static const Kernel& getKernel() {
+  static const Kernel kernel = []() -> Kernel {
+#ifdef PIXEL_CONVERT_X86
+    if (cpuSupports("avx2")) {
+      return {convertRowAVX2, "AVX2"};
+    }
+    if (cpuSupports("sse4.1")) {
+      return {convertRowSSE41, "SSE4.1"};
+    }
+#endif
+#ifdef PIXEL_CONVERT_NEON
+    return {convertRowNEON, "NEON"};
+#endif
+    return {convertRowScalar, "Scalar"};
+  }();
+
+  return kernel;
+}
+
+void convert(Direction direction,
+             const void* src,
+             ptrdiff_t srcRowBytes,
+             void* dst,
+             ptrdiff_t dstRowBytes,
+             size_t width,
+             size_t height,
+             short bitdepth,
+             bool flip,
+             ThreadPool* threadPool) {
+  if (bitdepth != 8 && bitdepth != 16 && bitdepth != 32) {
+    throw invalid_argument("Invalid bitdepth");
+  }
+
+  auto convertRow = getKernel().convertRow;
+
+  uint8_t mask[32];
+  makeShuffleMask(mask, bitdepth, direction);
+
+  auto* srcBytes = reinterpret_cast<const uint8_t*>(src);
+  auto* dstBytes = reinterpret_cast<uint8_t*>(dst);
+
+  auto convertRows = [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++) {
+      size_t srcY = flip ? (height - 1 - y) : y;
+      convertRow(srcBytes + (ptrdiff_t)srcY * srcRowBytes, dstBytes + (ptrdiff_t)y * dstRowBytes, width, bitdepth, direction, mask);
+    }
+  };
+
+  if (threadPool) {
+    threadPool->parallelFor(height, MinRowsPerTask, convertRows);
+  } else {
+    convertRows(0, height);
+  }
+}
+
+string getKernelName() {
+  return getKernel().name;
+}
+
+}  // namespace PixelConvert
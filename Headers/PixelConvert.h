@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "ThreadPool.hpp"
+
+using namespace std;
+
+/**
+ * CPU kernels doing the same conversions as ae2gl.fs and gl2ae.fs: reordering ARGB and RGBA, scaling AE's 16-bit range
+ * (0x0000-0x8000) from/to the full range of unsigned short, and flipping rows vertically. 32-bit pixels are only
+ * reordered. The fastest instruction set available on the running CPU is chosen at runtime.
+ */
+namespace PixelConvert {
+
+enum Direction { AEToGL, GLToAE };
+
+/**
+ * Converts the rows of src into dst, reading them from bottom to top when flip is true. The rows are split into chunks
+ * and converted in parallel when threadPool is given. src and dst may be the same buffer unless flipping.
+ */
+void convert(Direction direction,
+             const void* src,
+             ptrdiff_t srcRowBytes,
+             void* dst,
+             ptrdiff_t dstRowBytes,
+             size_t width,
+             size_t height,
+             short bitdepth,
+             bool flip,
+             ThreadPool* threadPool);
+
+/**
+ * Returns the name of the instruction set used by convert(), such as "AVX2", "SSE4.1", "NEON" or "Scalar".
+ */
+string getKernelName();
+
+}  // namespace PixelConvert
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <VVGL.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Debug.h"
+#include "Hash.hpp"
+#include "SystemUtil.h"
+
+using namespace std;
+
+/**
+ * Stores linked GL programs on disk by glGetProgramBinary(), so that the same shaders don't have to be compiled again
+ * after relaunching AE. A binary is only valid for the driver that created it, so the key includes the vendor, renderer
+ * and version strings as well as the sources. Binaries rejected by the driver are deleted, and the least recently used
+ * ones are deleted when the total size exceeds the budget. It does nothing where program binaries aren't supported.
+ */
+class ProgramBinaryCache {
+ private:
+  struct Header {
+    uint32_t magicNumber;
+    uint32_t format;
+    uint64_t length;
+  };
+
+  static const uint32_t MagicNumber = 0x50413449;  // "I4AP"
+
+  string _directory;
+  size_t _budget;
+  string _driverInfo;
+  bool _isSupported = false;
+  mutex _mutex;
+
+  string _getPath(const Digest128& sourceDigest) {
+    Hasher hasher;
+    hasher.add(sourceDigest);
+    hasher.update(_driverInfo);
+    auto key = hasher.digest128();
+
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx%016llx.bin", (unsigned long long)key.high, (unsigned long long)key.low);
+
+    return (filesystem::path(_directory) / name).string();
+  }
+
+  void _trim() {
+    struct Entry {
+      filesystem::path path;
+      filesystem::file_time_type time;
+      uintmax_t size;
+    };
+
+    vector<Entry> entries;
+    uintmax_t totalSize = 0;
+    error_code ec;
+
+    for (auto& file : filesystem::directory_iterator(_directory, ec)) {
+      if (file.path().extension() != ".bin") {
+        continue;
+      }
+
+      Entry entry = {file.path(), file.last_write_time(ec), file.file_size(ec)};
+      totalSize += entry.size;
+      entries.push_back(entry);
+    }
+
+    sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+    for (auto& entry : entries) {
+      if (totalSize <= _budget) {
+        break;
+      }
+
+      filesystem::remove(entry.path, ec);
+      totalSize -= entry.size;
+    }
+  }
+
+ public:
+  /**
+   * Must be created while a GL context is current to read the information of the driver.
+   */
+  ProgramBinaryCache(const string& directory, size_t budget) : _directory(directory), _budget(budget) {
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+
+    _isSupported = !_directory.empty() && numFormats > 0;
+
+    auto getString = [](GLenum name) {
+      auto* str = reinterpret_cast<const char*>(glGetString(name));
+      return string(str ? str : "");
+    };
+
+    _driverInfo = getString(GL_VENDOR) + "\n" + getString(GL_RENDERER) + "\n" + getString(GL_VERSION);
+#endif
+  }
+
+  bool isSupported() const { return _isSupported; }
+
+  /**
+   * Creates a program from the binary stored for the sources on the current context. Returns 0 when it's not stored or
+   * the driver rejects it, and then the program has to be compiled as usual.
+   */
+  GLuint load(const Digest128& sourceDigest) {
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    if (!_isSupported) {
+      return 0;
+    }
+
+    auto path = _getPath(sourceDigest);
+    vector<char> data;
+
+    {
+      lock_guard<mutex> lock(_mutex);
+
+      if (!SystemUtil::readBinaryFile(path, data)) {
+        return 0;
+      }
+
+      // Mark as recently used
+      error_code ec;
+      filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ec);
+    }
+
+    Header header;
+    if (data.size() < sizeof(Header)) {
+      return 0;
+    }
+    memcpy(&header, data.data(), sizeof(Header));
+
+    if (header.magicNumber != MagicNumber || header.length != data.size() - sizeof(Header)) {
+      return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, data.data() + sizeof(Header), (GLsizei)header.length);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if (!linked) {
+      FX_LOG("The driver rejected the program binary: " << path);
+      glDeleteProgram(program);
+
+      lock_guard<mutex> lock(_mutex);
+      error_code ec;
+      filesystem::remove(path, ec);
+
+      return 0;
+    }
+
+    return program;
+#else
+    return 0;
+#endif
+  }
+
+  /**
+   * Stores the binary of the program linked on the current context.
+   */
+  void store(const Digest128& sourceDigest, GLuint program) {
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    if (!_isSupported || program == 0) {
+      return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+    if (length <= 0) {
+      return;
+    }
+
+    vector<char> data(sizeof(Header) + length);
+    Header header = {MagicNumber, 0, 0};
+    GLenum format = 0;
+    GLsizei writtenLength = 0;
+
+    glGetProgramBinary(program, length, &writtenLength, &format, data.data() + sizeof(Header));
+
+    if (writtenLength <= 0) {
+      return;
+    }
+
+    header.format = format;
+    header.length = writtenLength;
+    memcpy(data.data(), &header, sizeof(Header));
+
+    lock_guard<mutex> lock(_mutex);
+
+    if (SystemUtil::writeBinaryFileAtomically(_getPath(sourceDigest), data.data(), sizeof(Header) + writtenLength)) {
+      _trim();
+    }
+#endif
+  }
+};
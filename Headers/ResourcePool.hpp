@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A thread-safe pool of resources that are expensive to create, such as GL contexts.
+ * A resource is created lazily by the factory until the pool reaches its capacity, and each checked-out resource is
+ * exclusively owned by the caller until it's checked in again.
+ */
+template <class T>
+class ResourcePool {
+ private:
+  function<shared_ptr<T>()> _factory;
+  size_t _capacity;
+  size_t _numCreated = 0;
+  vector<shared_ptr<T>> _idle;
+  mutex _mutex;
+  condition_variable _available;
+
+ public:
+  ResourcePool(const function<shared_ptr<T>()>& factory, size_t capacity) : _factory(factory), _capacity(capacity > 0 ? capacity : 1) {}
+
+  /**
+   * Returns an idle resource. When all of the resources are in use and the pool is full, it blocks until any other
+   * thread checks in one.
+   */
+  shared_ptr<T> checkout() {
+    unique_lock<mutex> lock(_mutex);
+
+    while (_idle.empty() && _numCreated >= _capacity) {
+      _available.wait(lock);
+    }
+
+    if (!_idle.empty()) {
+      auto resource = _idle.back();
+      _idle.pop_back();
+      return resource;
+    }
+
+    // Create a new one outside of the lock since it may take a while
+    _numCreated++;
+    lock.unlock();
+
+    try {
+      return _factory();
+    } catch (...) {
+      lock.lock();
+      _numCreated--;
+      _available.notify_one();
+      throw;
+    }
+  };
+
+  void checkin(const shared_ptr<T>& resource) {
+    if (!resource) {
+      return;
+    }
+
+    {
+      lock_guard<mutex> lock(_mutex);
+      _idle.push_back(resource);
+    }
+
+    _available.notify_one();
+  };
+
+  size_t capacity() const { return _capacity; };
+};
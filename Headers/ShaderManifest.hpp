@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cctype>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+/**
+ * What a shader uses, found by tokenizing its GLSL once when the code is loaded. As comments are skipped and only whole
+ * identifiers are matched, a built-in mentioned in a comment or a part of a longer name doesn't count.
+ */
+struct ShaderManifest {
+  // The ISF built-in variables referred by the code, such as TIME and RENDERSIZE.
+  unordered_set<string> builtins;
+  // The image inputs passed to any of the IMG_* functions.
+  unordered_set<string> sampledImages;
+  // The image inputs sampled at pixels other than the one being shaded, by IMG_PIXEL or IMG_NORM_PIXEL.
+  unordered_set<string> imagesSampledElsewhere;
+  // True when textures are sampled by the GLSL functions directly, so it's unknown which images are sampled where.
+  bool samplesTexturesDirectly = false;
+  bool usesFragCoord = false;
+  // The margins declared by the "I4A_MARGIN" key of the image inputs, in pixels at full resolution.
+  map<string, int> samplingMargins;
+  size_t numPasses = 1;
+  bool hasPersistentBuffers = false;
+
+  bool isTimeDependant() const {
+    for (auto* name : {"TIME", "TIMEDELTA", "FRAMEINDEX", "DATE"}) {
+      if (builtins.count(name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Returns true if the image is only sampled at the pixel being shaded, or not sampled at all.
+   */
+  bool isSampledLocally(const string& imageName) const { return !samplesTexturesDirectly && !imagesSampledElsewhere.count(imageName); }
+
+  /**
+   * Adds what the code uses to the manifest. The passes are left as they are since they're declared in the JSON.
+   */
+  void analyze(const string& code) {
+    auto tokens = _tokenize(code);
+
+    for (size_t i = 0; i < tokens.size(); i++) {
+      auto& token = tokens[i];
+
+      if (token == "TIME" || token == "TIMEDELTA" || token == "FRAMEINDEX" || token == "DATE" || token == "RENDERSIZE" ||
+          token == "PASSINDEX" || token == "isf_FragNormCoord") {
+        builtins.insert(token);
+        continue;
+      }
+
+      if (token == "gl_FragCoord") {
+        usesFragCoord = true;
+        continue;
+      }
+
+      bool isCall = i + 1 < tokens.size() && tokens[i + 1] == "(";
+
+      if (!isCall) {
+        continue;
+      }
+
+      if (token == "texture2D" || token == "texture2DRect" || token == "texture" || token == "texelFetch") {
+        samplesTexturesDirectly = true;
+
+      } else if (token == "IMG_PIXEL" || token == "IMG_NORM_PIXEL" || token == "IMG_THIS_PIXEL" || token == "IMG_THIS_NORM_PIXEL") {
+        if (i + 2 < tokens.size() && _isIdentifier(tokens[i + 2])) {
+          sampledImages.insert(tokens[i + 2]);
+
+          if (token == "IMG_PIXEL" || token == "IMG_NORM_PIXEL") {
+            imagesSampledElsewhere.insert(tokens[i + 2]);
+          }
+        } else {
+          // The image is given by an expression such as a macro
+          samplesTexturesDirectly = true;
+        }
+      }
+    }
+  }
+
+ private:
+  static bool _isIdentifierChar(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+  static bool _isIdentifier(const string& token) { return !token.empty() && (isalpha((unsigned char)token[0]) || token[0] == '_'); }
+
+  /**
+   * Splits the code into identifiers, numbers and single punctuation characters, skipping whitespace and comments.
+   * Preprocessor directives are tokenized as well, since macros may refer to built-ins.
+   */
+  static vector<string> _tokenize(const string& code) {
+    vector<string> tokens;
+    size_t i = 0, n = code.size();
+
+    while (i < n) {
+      char c = code[i];
+
+      if (isspace((unsigned char)c)) {
+        i++;
+      } else if (c == '/' && i + 1 < n && code[i + 1] == '/') {
+        i = code.find('\n', i);
+        i = i == string::npos ? n : i + 1;
+      } else if (c == '/' && i + 1 < n && code[i + 1] == '*') {
+        i = code.find("*/", i + 2);
+        i = i == string::npos ? n : i + 2;
+      } else if (_isIdentifierChar(c)) {
+        size_t start = i;
+        // Numbers such as 1.0e-3 are kept as a single token together with their dots and exponent signs
+        bool isNumber = isdigit((unsigned char)c);
+        while (i < n && (_isIdentifierChar(code[i]) || (isNumber && (code[i] == '.' || ((code[i] == '-' || code[i] == '+') && tolower(code[i - 1]) == 'e'))))) {
+          i++;
+        }
+        tokens.push_back(code.substr(start, i - start));
+      } else {
+        tokens.push_back(string(1, c));
+        i++;
+      }
+    }
+
+    return tokens;
+  }
+};
@@ -1,8 +1,11 @@
 #include "SystemUtil.h"
 
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #include "Debug.h"
 
@@ -204,4 +207,73 @@ bool writeTextFile(const string& path, const string& text) {
   return true;
 }
 
+bool readBinaryFile(const string& path, vector<char>& data) {
+  ifstream file(path, ios::binary | ios::ate);
+
+  if (!file) {
+    return false;
+  }
+
+  auto size = file.tellg();
+
+  if (size < 0) {
+    return false;
+  }
+
+  data.resize((size_t)size);
+  file.seekg(0);
+
+  return (bool)file.read(data.data(), size);
+}
+
+bool writeBinaryFileAtomically(const string& path, const void* data, size_t size) {
+  stringstream tmpPath;
+  tmpPath << path << ".tmp" << hash<thread::id>()(this_thread::get_id());
+
+  {
+    ofstream file(tmpPath.str(), ios::binary | ios::trunc);
+
+    if (!file || !file.write(reinterpret_cast<const char*>(data), size)) {
+      FX_LOG("Couldn't write a file to the specified path: " << tmpPath.str());
+      return false;
+    }
+  }
+
+  error_code ec;
+  filesystem::rename(tmpPath.str(), path, ec);
+
+  if (ec) {
+    filesystem::remove(tmpPath.str(), ec);
+    return false;
+  }
+
+  return true;
+}
+
+string getCacheDirectory() {
+#ifdef _WIN32
+  const char* base = getenv("LOCALAPPDATA");
+  string subdirectory = "ISF4AE\\Cache";
+#else
+  const char* base = getenv("HOME");
+  string subdirectory = "Library/Caches/ISF4AE";
+#endif
+
+  if (!base) {
+    return "";
+  }
+
+  auto directory = filesystem::path(base) / subdirectory;
+
+  error_code ec;
+  filesystem::create_directories(directory, ec);
+
+  if (ec) {
+    FX_LOG("Couldn't create the cache directory: " << directory.string());
+    return "";
+  }
+
+  return directory.string();
+}
+
 };  // namespace SystemUtil
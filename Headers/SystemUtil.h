@@ -26,4 +26,18 @@ string readResourceShader(const string& path);
 
 bool writeTextFile(const string& path, const string& text);
 
+bool readBinaryFile(const string& path, vector<char>& data);
+
+/**
+ * Writes the data to a temporary file next to the path and then renames it, so that other processes never read a
+ * partially written file.
+ */
+bool writeBinaryFileAtomically(const string& path, const void* data, size_t size);
+
+/**
+ * Returns the directory for caches of this plug-in in the user's cache folder, creating it if necessary. Returns an
+ * empty string on failure.
+ */
+string getCacheDirectory();
+
 };  // namespace SystemUtil
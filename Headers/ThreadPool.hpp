@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A fixed number of worker threads for splitting a loop into chunks that run in parallel, or for running tasks in
+ * background. Tasks are taken in the order they're posted.
+ */
+class ThreadPool {
+ private:
+  vector<thread> _workers;
+  deque<function<void()>> _tasks;
+  mutex _mutex;
+  condition_variable _taskAvailable;
+  bool _stopping = false;
+
+  void _work() {
+    while (true) {
+      function<void()> task;
+
+      {
+        unique_lock<mutex> lock(_mutex);
+        _taskAvailable.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+
+        if (_stopping && _tasks.empty()) {
+          return;
+        }
+
+        task = move(_tasks.front());
+        _tasks.pop_front();
+      }
+
+      task();
+    }
+  }
+
+ public:
+  ThreadPool(size_t numThreads) {
+    for (size_t i = 0; i < numThreads; i++) {
+      _workers.emplace_back([this] { _work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _stopping = true;
+    }
+
+    _taskAvailable.notify_all();
+
+    for (auto& worker : _workers) {
+      worker.join();
+    }
+  }
+
+  size_t size() const { return _workers.size(); }
+
+  /**
+   * Runs the task on any of the workers without waiting for it. Tasks remaining at destruction are still run.
+   */
+  void post(const function<void()>& task) {
+    {
+      lock_guard<mutex> lock(_mutex);
+      _tasks.push_back(task);
+    }
+
+    _taskAvailable.notify_one();
+  }
+
+  /**
+   * Calls fn(begin, end) for the chunks of range [0, count), each of which has at least minChunkSize items, and blocks
+   * until all of them are done. The calling thread also takes chunks, so it can be called from multiple threads at the
+   * same time without waiting for each other's chunks to be picked up.
+   */
+  void parallelFor(size_t count, size_t minChunkSize, const function<void(size_t, size_t)>& fn) {
+    size_t numChunks = min(_workers.size() + 1, count / max<size_t>(minChunkSize, 1));
+
+    if (numChunks <= 1) {
+      if (count > 0) {
+        fn(0, count);
+      }
+      return;
+    }
+
+    struct State {
+      atomic<size_t> nextChunk{0};
+      size_t numDone = 0;
+      mutex numDoneMutex;
+      condition_variable done;
+    };
+
+    // Helper tasks may start after all chunks are done, thus the state is shared with them.
+    auto state = make_shared<State>();
+    size_t chunkSize = (count + numChunks - 1) / numChunks;
+    auto* pFn = &fn;
+
+    auto runChunks = [state, numChunks, chunkSize, count, pFn]() {
+      size_t chunk;
+      while ((chunk = state->nextChunk++) < numChunks) {
+        size_t begin = chunk * chunkSize;
+        size_t end = min(begin + chunkSize, count);
+
+        if (begin < end) {
+          (*pFn)(begin, end);
+        }
+
+        lock_guard<mutex> lock(state->numDoneMutex);
+        if (++state->numDone == numChunks) {
+          state->done.notify_all();
+        }
+      }
+    };
+
+    {
+      lock_guard<mutex> lock(_mutex);
+      for (size_t i = 1; i < numChunks; i++) {
+        _tasks.push_back(runChunks);
+      }
+    }
+
+    _taskAvailable.notify_all();
+
+    runChunks();
+
+    unique_lock<mutex> lock(state->numDoneMutex);
+    state->done.wait(lock, [&state, numChunks] { return state->numDone == numChunks; });
+  }
+};
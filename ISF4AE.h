@@ -33,12 +33,24 @@ typedef unsigned short PixelType;
 #include "AEFX_ChannelDepthTpl.h"
 #include "AEGP_SuiteHandler.h"
 
+#include <functional>
+#include <future>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <VVISF.hpp>
 
+#include "FileWatcher.hpp"
+#include "FlatIsf.hpp"
+#include "FrameCache.hpp"
+#include "Hash.hpp"
 #include "ISF4AEScene.hpp"
-#include "WeakMap.hpp"
+#include "LRUCache.hpp"
+#include "LZ.hpp"
+#include "PixelConvert.h"
+#include "ResourcePool.hpp"
+#include "ThreadPool.hpp"
 
 #include "Config.h"
 
@@ -68,6 +80,22 @@ using namespace std;
 #define DEFAULT_ISF_DIRECTORY ".\\"
 #endif
 
+// Set to 0 to convert pixels between AE and OpenGL by the separate ae2gl and gl2ae passes, instead of injecting the
+// conversion into the program of each ISF.
+#define FUSE_AE_CONVERSION 1
+
+// Set to 1 to convert pixels of scenes that don't fuse the conversion by the SIMD kernels on CPU, instead of the ae2gl
+// and gl2ae passes, when OpenGL is implemented by a software renderer, such as on render nodes without GPU. The passes
+// are rasterized on CPU there as well, and tests/bench_ae_conversion measures them to be slower than the kernels.
+#define CPU_AE_CONVERSION 1
+
+// Set to 1 to compile a variant of each shader with the bool and long inputs that are not animated replaced by
+// constants, so that the branches on them are folded. The generic program is used while the variant is compiled.
+#define SPECIALIZE_CONSTANT_INPUTS 1
+
+// Set to 1 to reload the shader files loaded by the "Load" button whenever they're saved, for developing shaders.
+#define WATCH_SHADER_FILES 1
+
 #define BUTTON_WIDTH 70
 #define BUTTON_HEIGHT 16
 #define BUTTON_MARGIN 10
@@ -120,37 +148,177 @@ static const uint32_t NumUserParams = 16;
 
 static const uint32_t NumParams = Param_UserOffset + NumUserParams * NumUserParamType;
 
+// The maximum number of frames rendered concurrently with Multi-Frame Rendering.
+static const uint32_t MaxRenderContexts = 16;
+
+// The maximum number of shaders compiled concurrently, such as the ones of all effect instances in a project just opened.
+static const uint32_t MaxCompileThreads = 8;
+
+// The maximum number of variants of a shader specialized on the values of constant inputs.
+static const uint32_t MaxSpecializedVariants = 16;
+
+// How often the watched shader files are checked for modification, in milliseconds.
+static const uint32_t FileWatchInterval = 250;
+
+// The size of the rect to checkout an entire layer, which exceeds the maximum layer size of AE (30,000 px).
+static const A_long MaxCheckoutLayerSize = 1 << 20;
+
+// The number of pixel pack buffers each render context cycles through for reading back frames.
+static const uint32_t NumReadbackBuffers = 2;
+
+// The maximum size of a texture that a frame is rendered into at once. Larger frames are rendered tile by tile.
+static const size_t MaxTileBytes = 256 * 1024 * 1024;
+
+// The pixels each tile is rendered beyond its edges and then discarded, in case the driver rasterizes the edges of the
+// viewport differently.
+static const A_long TileOverlap = 2;
+
+// The maximum total size of rendered frames kept in memory for reusing them while scrubbing.
+static const size_t FrameCacheBytes = 1024 * 1024 * 1024;
+
+// The estimated memory that compiled shaders no longer used by any effect instance may hold until they're evicted.
+static const size_t SceneCacheBytes = 256 * 1024 * 1024;
+
+// The maximum total size of linked program binaries stored on disk to skip compiling shaders after relaunching AE.
+static const size_t ProgramBinaryCacheBytes = 64 * 1024 * 1024;
+
 struct SceneDesc {
+  // The digest of the source code, which identifies the shader even after the scene is compiled again.
+  Digest128 digest;
   VVISF::ISF4AESceneRef scene;
+  // The parsed document and what the code uses, which the UI reads instead of the scene since they're available before
+  // the shader is compiled. They're the ones of the default scene when the code fails to parse or compile.
+  VVISF::ISFDocRef doc;
+  ShaderManifest manifest;
   string status;
   string errorLog;
+  // Valid until the shader is compiled in background. Such a placeholder only has the document parsed without any GL
+  // context, and its scene is the default one. Use resolveSceneDesc() to get the compiled one once it's ready.
+  shared_future<shared_ptr<SceneDesc>> compiled;
+  // The codes the shader is created from, which are compiled on the first request and saved to the project as they are.
+  string fsCode, vsCode;
+  shared_ptr<promise<shared_ptr<SceneDesc>>> compilePromise;
+  atomic<bool> compileRequested{false};
+  // The digests of the variants specialized on the values of constant inputs, which are counted only once even if the
+  // compiled variant is evicted and created again.
+  mutex variantsMutex;
+  unordered_set<Digest128, Digest128Hash> variantDigests;
+  // The compressed codes written by FlattenArb, which are made once and shared by FlatSizeArb and every instance.
+  once_flag flatCodeOnce;
+  vector<char> flatCode;
+  // The size of flatCode, which the scene cache reads without waiting for the codes being compressed.
+  atomic<size_t> flatCodeSize{0};
 };
 
-struct GlobalData {
-  AEGP_PluginID aegpId;
+// Counts the shaders loaded in the session and the ones actually compiled, which are only compiled when needed. A shader
+// is counted as compiled once its compilation finishes, whether it succeeded or not.
+struct CompileStats {
+  atomic<size_t> numRegistered{0};
+  atomic<size_t> numCompiled{0};
+};
+
+// A pixel pack buffer that a rendered frame is read back into asynchronously.
+struct ReadbackBuffer {
+  GLuint pbo = 0;
+  size_t capacity = 0;
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+  GLsync fence = nullptr;
+#endif
+  size_t bytesPerRow = 0;
+  size_t height = 0;
+  // True when the rows are stored from bottom to top.
+  bool flipped = false;
+};
+
+// Durations of each stage of the last frame rendered in SmartRender, in milliseconds. When tiles are read back while the
+// next ones are rendered, the time of each stage is summed up over the tiles.
+struct RenderTimings {
+  double upload = 0;
+  double render = 0;
+  double readback = 0;
+  double copy = 0;
+};
+
+// A set of GL objects used for rendering a single frame. Each render thread checks out one from the pool in GlobalData
+// so that frames can be rendered in parallel.
+struct RenderContext {
   VVGL::GLContextRef context;
   VVGL::GLCPUToTexCopierRef uploader;
   VVGL::GLTexToCPUCopierRef downloader;
-  // The UV gradient shader that is applied when no shaders loaded or failed to compile.
-  VVISF::ISF4AESceneRef defaultScene;
   // For filling the gap between the format of OpenGL texture and After Effects' image buffer.
   VVISF::ISF4AESceneRef ae2glScene, gl2aeScene;
+  // Clones of ISF scenes bound to this context, keyed by the scene they're cloned from.
+  unordered_map<VVISF::ISF4AEScene*, pair<weak_ptr<VVISF::ISF4AEScene>, VVISF::ISF4AESceneRef>> scenes;
+  // Workers for converting pixels on CPU, owned by GlobalData.
+  ThreadPool* threadPool = nullptr;
+  vector<char> conversionBuffer;
+  // A framebuffer for reading pixels of a texture.
+  GLuint readFramebuffer = 0;
+  ReadbackBuffer readbackBuffers[NumReadbackBuffers];
+  size_t nextReadbackBuffer = 0;
+  RenderTimings timings;
+  GLint maxTextureSize = 0;
+  // True when OpenGL is rasterized on CPU, where the CPU kernels convert pixels faster than the ae2gl and gl2ae passes.
+  bool isSoftwareRenderer = false;
+
+  ~RenderContext();
+};
+
+struct GlobalData {
+  AEGP_PluginID aegpId;
+  VVGL::GLContextRef context;
+  // The UV gradient shader that is applied when no shaders loaded or failed to compile.
+  VVISF::ISF4AESceneRef defaultScene;
+  shared_ptr<ResourcePool<RenderContext>> renderContexts;
+  shared_ptr<ThreadPool> threadPool;
+  // Workers that compile shaders in background so that loading them doesn't block the UI. Each scene is compiled on its
+  // own shared context, so the distinct shaders are compiled in parallel.
+  shared_ptr<ThreadPool> compileQueue;
+  shared_ptr<CompileStats> compileStats;
+  shared_ptr<FileWatcher> fileWatcher;
+  shared_ptr<FrameCache> frameCache;
   shared_ptr<SceneDesc> notLoadedSceneDesc;
-  // Caches shader program by using the code as a key.
-  shared_ptr<WeakMap<string, SceneDesc>> scenes;
-#ifndef _WIN32
-  NSLock* lock;
-#endif
+  // Caches shader program by using the digest of the code as a key. The ones referred by ParamArbIsf are never evicted.
+  shared_ptr<LRUCache<Digest128, SceneDesc, Digest128Hash>> scenes;
+  shared_ptr<ProgramBinaryCache> programBinaryCache;
+};
+
+enum ParamVisibility : A_u_char {
+  ParamVisibility_Unknown = 0,
+  ParamVisibility_Hidden,
+  ParamVisibility_Visible,
+};
+
+// The UI of a parameter last applied by UpdateParamsUI, so that only the changes are applied. Zero means unknown.
+struct ParamUIState {
+  ParamVisibility visibility;
+  // The digest of the name and the options such as the default and the range.
+  uint64_t digest;
 };
 
 struct SequenceData {
   bool showISFOption;
+  // Not flattened, since the UI applied before isn't known after reopening the project.
+  ParamUIState paramUIStates[NumParams];
+  // Whether each param is neither keyframed nor driven by an expression, as found by UpdateParamsUI on the UI thread.
+  // SmartPreRender only reads it since AEGP streams can't be accessed from render threads. A stale flag never changes
+  // the rendered result, as the values themselves are still read at each frame.
+  bool isParamConstant[NumParams];
 };
 
-// The data that is initialized in SmartPreRender and passed to SmartRender.
+// The sequence data saved in the project and copied to render threads. The older versions only have showISFOption.
+struct FlatSequenceData {
+  bool showISFOption;
+  bool isParamConstant[NumParams];
+};
+
+// The data that is allocated in SmartPreRender and passed to SmartRender. AE frees it by DeletePreRenderData.
 struct PreRenderData {
-  VVISF::ISF4AEScene* scene;
+  VVISF::ISF4AESceneRef scene;
+  Digest128 sceneDigest;
   VVGL::Size outSize;
+  // The region of the output to render, which is same as the result rect.
+  PF_Rect renderRect;
   VVGL::Size inputImageSizes[NumUserParams];
 };
 
@@ -159,16 +327,12 @@ struct PreRenderData {
 struct ParamArbIsf {
   string name;
   shared_ptr<SceneDesc> desc;
-};
-
-#define ARB_ISF_FLAT_V1_MAGIC_NUMBER 0x01
-
-struct ParamArbIsfFlatV1 {
-  A_u_char magicNumber;  // Always should be set to ARB_ISF_FLAT_V1_MAGIC_NUMBER
-  A_u_long version;
-  A_u_long offsetName;
-  A_u_long offsetFragCode;
-  A_u_long offsetVertCode;
+  // The file the shader was loaded from, which is watched for reloading.
+  string path;
+  // The sum of the versions of the watched files when they were read last time.
+  uint64_t watchedVersion;
+  // The shader reloaded from the modified files, which replaces desc once it's compiled.
+  shared_ptr<SceneDesc> pendingDesc;
 };
 
 // Implemented in ISF4AE_UtilFunc.cpp
@@ -177,22 +341,79 @@ PF_ParamIndex getIdForUserParam(PF_ParamIndex index, UserParamType type);
 UserParamType getUserParamTypeForISFAttr(const VVISF::ISFAttrRef input);
 PF_Fixed getDefaultForAngleInput(VVISF::ISFAttrRef input);
 bool isISFAttrVisibleInECW(const VVISF::ISFAttrRef input);
-shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string& fsCode, const string& vsCode);
+shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string& fsCode, const string& vsCode, const ShaderManifest* manifest = nullptr);
+shared_ptr<SceneDesc> requestCompiledSceneDesc(GlobalData* globalData, const shared_ptr<SceneDesc>& desc);
+shared_ptr<SceneDesc> resolveSceneDesc(const shared_ptr<SceneDesc>& desc);
+shared_ptr<SceneDesc> getSpecializedSceneDesc(GlobalData* globalData, const shared_ptr<SceneDesc>& desc, const map<string, string>& constants);
+PF_Err setSceneDescKeepingValues(PF_InData* in_data, PF_ParamDef* params[], const shared_ptr<SceneDesc>& desc);
+void readShaderFiles(const string& srcPath, string* fsCode, string* vsCode);
+vector<string> getShaderFilePaths(const string& srcPath);
 PF_Err loadISF(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[]);
+shared_ptr<RenderContext> createRenderContext(const VVGL::GLContextRef& sharedContext,
+                                              const string& ae2glCode,
+                                              const string& gl2aeCode,
+                                              ThreadPool* threadPool);
+bool convertsAEFormatOnCPU(const RenderContext& renderContext, const ISF4AEScene& scene);
+VVISF::ISF4AESceneRef getSceneForRenderContext(RenderContext& renderContext, const VVISF::ISF4AESceneRef& scene);
 PF_Err saveISF(PF_InData* in_data, PF_OutData* out_data);
 VVGL::GLBufferRef createRGBATexWithBitdepth(const VVGL::Size& size, VVGL::GLContextRef context, short bitdepth);
 VVGL::GLBufferRef createRGBACPUBufferWithBitdepthUsing(const VVGL::Size& inCPUBufferSizeInPixels,
                                                        const void* inCPUBackingPtr,
                                                        const VVGL::Size& inImageSizeInPixels,
                                                        const short bitdepth);
-PF_Err uploadCPUBufferInSmartRender(GlobalData* globalData,
-                                    PF_ProgPtr effectRef,
-                                    PF_SmartRenderExtra* extra,
-                                    A_long checkoutIndex,
+void setTextureSwizzleFromAE(const VVGL::GLBufferRef& texture, bool fromAE);
+PF_Err uploadCPUBufferInSmartRender(RenderContext& renderContext,
+                                    PF_LayerDef* layerDef,
+                                    short bitdepth,
                                     const VVGL::Size outImageSize,
+                                    bool keepsAELayout,
                                     VVGL::GLBufferRef& outImage);
-PF_Err
-renderISFToCPUBuffer(PF_InData* in_data, PF_OutData* out_data, ISF4AEScene& scene, short bitdepth, VVGL::Size& outSize, VVGL::Size& pointScale, VVGL::GLBufferRef* outBuffer);
+void getConstantInputValues(PF_InData* in_data, PF_OutData* out_data, const SequenceData& seqData, ISF4AEScene& scene, map<string, string>* constants);
+void hashISFInputValues(Hasher& hasher, ISF4AEScene& scene);
+PF_Err setISFInputValues(PF_InData* in_data, PF_OutData* out_data, ISF4AEScene& scene, VVGL::Size& outSize, VVGL::Size& pointScale, double* outTime);
+PF_Err renderISFToTexture(PF_InData* in_data,
+                          PF_OutData* out_data,
+                          RenderContext& renderContext,
+                          ISF4AEScene& scene,
+                          short bitdepth,
+                          VVGL::Size& outSize,
+                          double time,
+                          const PF_Rect& region,
+                          VVGL::GLBufferRef* outTexture);
+bool getTileSize(const RenderContext& renderContext, ISF4AEScene& scene, short bitdepth, const VVGL::Size& outSize, A_long* tileWidth, A_long* tileHeight);
+PF_Err renderISFTiles(PF_InData* in_data,
+                      PF_OutData* out_data,
+                      RenderContext& renderContext,
+                      ISF4AEScene& scene,
+                      short bitdepth,
+                      VVGL::Size& outSize,
+                      double time,
+                      const PF_Rect& region,
+                      A_long tileWidth,
+                      A_long tileHeight,
+                      const function<PF_Err(const PF_Rect& tile, const VVGL::GLBufferRef& texture, const PF_Rect& textureRect)>& onTileRendered);
+PF_Err renderISFToCPUBuffer(PF_InData* in_data,
+                            PF_OutData* out_data,
+                            RenderContext& renderContext,
+                            ISF4AEScene& scene,
+                            short bitdepth,
+                            VVGL::Size& outSize,
+                            VVGL::Size& pointScale,
+                            VVGL::GLBufferRef* outBuffer);
+bool downloadTexToEffectWorld(RenderContext& renderContext, const VVGL::GLBufferRef& texture, short bitdepth, const PF_Rect& region, PF_EffectWorld* world);
+void copyReadbackToEffectWorld(RenderContext& renderContext,
+                               const ReadbackBuffer& readback,
+                               const char* pixels,
+                               bool convertsOnCPU,
+                               short bitdepth,
+                               A_long left,
+                               A_long top,
+                               PF_EffectWorld* world);
+shared_ptr<const FrameCache::Frame> copyEffectWorldToFrame(const PF_EffectWorld* world, size_t width, size_t height, short bitdepth);
+void copyFrameToEffectWorld(const FrameCache::Frame& frame, PF_EffectWorld* world);
+ReadbackBuffer& beginReadback(RenderContext& renderContext, const VVGL::GLBufferRef& texture, short bitdepth, const PF_Rect& region);
+const char* mapReadback(ReadbackBuffer& readback);
+void unmapReadback(ReadbackBuffer& readback);
 
 // Implemented in ISF4AE_ArbHandler.cpp
 PF_Err CreateDefaultArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbitraryH* dephault);
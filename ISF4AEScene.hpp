@@ -1,12 +1,18 @@
 #pragma once
 
 #include <VVISF.hpp>
+#include <atomic>
+#include <cmath>
 #include <map>
 #include <regex>
 #include <sstream>
 #include <string>
 #include <unordered_set>
 
+#include "Hash.hpp"
+#include "ProgramBinaryCache.hpp"
+#include "ShaderManifest.hpp"
+
 using namespace std;
 using namespace VVGL;
 using namespace VVISF;
@@ -22,19 +28,280 @@ class ISF4AEScene : public ISFScene {
 
   ISF4AEScene(const GLContextRef& inCtx) : ISFScene(inCtx) { _setUpRenderPrepCallback(); }
 
-  void useCode(const string& fsCode, const string& vsCode) {
-    ISFDocRef doc = nullptr;
+  ~ISF4AEScene() {
+    if (_cloneOf) {
+      (*_cloneOf)--;
+    }
+  }
+
+  /**
+   * Compiles the code. The manifest can be given if it's already analyzed from the same code, to skip analyzing it. What
+   * is injected into the code is decided by the manifest, so that the code is compiled only once even if it's broken.
+   * The injected code keeps the line numbers, so the error log still refers to the user's code.
+   */
+  void useCode(const string& fsCode, const string& vsCode, const ShaderManifest* manifest = nullptr) {
+    _fsCode = fsCode;
+    _vsCode = vsCode;
+
+    _manifest = _analyzeCode(fsCode, vsCode, manifest);
+
+    // Only the IMG_* functions can be wrapped by the conversion
+    _fusesAEConversion = _fusesAEConversion && !_manifest.samplesTexturesDirectly;
+    _offsetsFragCoord = true;
+
+    string injectedFsCode = _manifest.usesFragCoord ? _injectFragCoordOffset(fsCode) : fsCode;
+
+    if (_fusesAEConversion) {
+      injectedFsCode = _injectAEConversion(injectedFsCode);
+    }
+
+    string injectedVsCode = _injectTileTransform(vsCode, &_transformsTile);
+
+    _useCode(injectedFsCode, injectedVsCode);
+  }
+
+  /**
+   * Only parses the code into a document without creating a scene nor a GL context, so that the inputs can be listed
+   * while the program is compiled in background. What the code uses is written to outManifest, which is copied from the
+   * given manifest if it's already analyzed.
+   */
+  static ISFDocRef parseCode(const string& fsCode, const string& vsCode, const ShaderManifest* manifest, ShaderManifest* outManifest) {
+    auto doc = _createDoc(fsCode, vsCode);
+    _checkInputNames(*doc);
+
+    *outManifest = _analyzeCode(fsCode, vsCode, manifest);
+    _analyzePasses(*doc, outManifest);
+
+    return doc;
+  }
+
+  /**
+   * Creates a scene on another GL context with the same code. As the clone has its own document, input values, pass
+   * buffers and program, it can be rendered on a different thread at the same time.
+   * Note that the program cannot be shared between the two even if their contexts are shared, since uniform values
+   * belong to the program object and would be overwritten by each other.
+   */
+  shared_ptr<ISF4AEScene> cloneUsing(const GLContextRef& inCtx) {
+    auto clone = make_shared<ISF4AEScene>(inCtx);
+    clone->setManualTime(true);
+    clone->setFusesAEConversion(_fusesAEConversion);
+    clone->setProgramBinaryCache(_programBinaryCache);
+    clone->useCode(_fsCode, _vsCode, &_manifest);
+
+    clone->_cloneOf = _numClones;
+    (*_numClones)++;
+
+    return clone;
+  }
+
+  /**
+   * Returns the number of the clones alive, which hold their own program and buffers.
+   */
+  size_t numClones() const { return *_numClones; }
+
+  /**
+   * When enabled before calling useCode(), the conversion between the pixel format of After Effects and OpenGL is
+   * injected into the program, so that image inputs can be bound as AE-layout textures and the result is written in
+   * AE's layout, skipping the ae2gl and gl2ae passes. It's disabled automatically if the code samples textures directly.
+   */
+  void setFusesAEConversion(bool fuses) { _fusesAEConversion = fuses; }
+
+  bool fusesAEConversion() const { return _fusesAEConversion; }
+
+  /**
+   * Set before calling useCode() to load the linked program from the disk instead of compiling it when possible.
+   */
+  void setProgramBinaryCache(const shared_ptr<ProgramBinaryCache>& cache) { _programBinaryCache = cache; }
+
+  /**
+   * Sets the scale applied to pixels while converting between the formats, which is only used when the conversion is
+   * fused.
+   */
+  void setMultiplier16bit(float multiplier) { _multiplier16bit = multiplier; }
+
+  /**
+   * Limits the pixels to be shaded by the scissor test, in OpenGL's window coordinates. The other pixels in the output
+   * buffer are left undefined. Set an empty rect to shade the whole buffer.
+   */
+  void setScissorRect(const Rect& rect) { _scissorRect = rect; }
+
+  /**
+   * Renders only the tile of the output into a buffer of the tile size, which is in OpenGL's window coordinates of the
+   * whole output of the given size. The viewport is as large as the tile, and the quad covering the whole output is
+   * mapped onto it, while gl_FragCoord is shifted by the origin of the tile. So the coordinates and the uniforms are the
+   * same as rendering the whole output at once. Set an empty rect to render the whole output.
+   */
+  void setTileRect(const Rect& rect, const Size& outputSize = Size(0, 0)) {
+    _tileRect = rect;
+    _tileOutputSize = outputSize;
+  }
+
+  map<string, string> errDict() { return _errDict; }
+
+  /**
+   * Returns what the code uses, which is analyzed once when the code is loaded.
+   */
+  const ShaderManifest& manifest() const { return _manifest; }
+
+  bool isTimeDependant() const { return _manifest.isTimeDependant(); }
+
+  /**
+   * Returns true if the output can be rendered partially, as long as each image input is given around the region within
+   * the margin returned by getSamplingMargin(). It's decided conservatively: a single pass without persistent buffers or
+   * a custom vertex shader, whose image inputs all have known margins.
+   */
+  bool canRenderRegion() {
+    if (!_vsCode.empty() || _manifest.numPasses > 1 || _manifest.hasPersistentBuffers) {
+      return false;
+    }
+
+    for (auto& input : inputs()) {
+      if (input->type() == ISFValType_Image && getSamplingMargin(input->name()) < 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * Returns true if the output can be rendered tile by tile into buffers smaller than the render size. It requires a
+   * single pass without persistent buffers, since the buffers of the other passes would still have to cover the whole
+   * output.
+   */
+  bool canRenderTiled() const { return _offsetsFragCoord && _transformsTile && _manifest.numPasses <= 1 && !_manifest.hasPersistentBuffers; }
+
+  /**
+   * Returns how far from each output pixel the image input is sampled, in pixels at full resolution, or -1 if unknown.
+   * It's read from the "I4A_MARGIN" key of the input if specified. Otherwise it's 0 when the shader samples the image
+   * only at the same position by IMG_THIS_PIXEL or IMG_THIS_NORM_PIXEL, or doesn't sample it at all.
+   */
+  int getSamplingMargin(const string& inputName) const {
+    auto it = _manifest.samplingMargins.find(inputName);
+
+    if (it != _manifest.samplingMargins.end()) {
+      return it->second;
+    }
+
+    return _manifest.isSampledLocally(inputName) ? 0 : -1;
+  }
+
+  /**
+   * Estimates the bytes held by the scene: the sources and the parsed JSON document, the linked program, and the buffers
+   * of the persistent and temporary pass targets allocated so far.
+   */
+  size_t estimateMemoryUsage() {
+    size_t bytes = _fsCode.size() + _vsCode.size() + _programBytes;
+
+    auto doc = this->doc();
+
+    if (doc) {
+      bytes += doc->jsonSourceString()->size() + doc->fragShaderSource()->size() + doc->vertShaderSource()->size();
+      bytes += doc->inputs().size() * sizeof(ISFAttr);
+
+      for (auto* targets : {&doc->persistentBuffers(), &doc->tempBuffers()}) {
+        for (auto& target : *targets) {
+          auto buffer = target->buffer();
+          if (buffer) {
+            bytes += (size_t)(buffer->size.width * buffer->size.height) * (target->floatFlag() ? 16 : 4);
+          }
+        }
+      }
+    }
+
+    return bytes;
+  }
+
+  /**
+   * Returns the code as the user wrote, without the code injected for the fused conversion.
+   */
+  string getFragCode() {
+    if (!_fsCode.empty()) {
+      return _fsCode;
+    }
+
+    auto doc = this->doc();
+
+    return *doc->jsonSourceString() + *doc->fragShaderSource();
+  }
+
+  /**
+   * Returns the vertex shader as the user wrote, which is empty when the passthrough one is used.
+   */
+  const string& getVertCode() const { return _vsCode; }
+
+  /**
+   * Returns the code with the given inputs replaced by constants, so that the compiler can fold the branches on them.
+   * The macros are defined after the uniform declarations generated by VVISF, so they only affect the user's code.
+   * Returns the code as it is if there's no JSON blob to put them after.
+   */
+  string getSpecializedFragCode(const map<string, string>& constants) {
+    string fsCode = getFragCode();
+    auto jsonEnd = fsCode.find("*/");
+
+    if (jsonEnd == string::npos || constants.empty()) {
+      return fsCode;
+    }
+    jsonEnd += 2;
+
+    stringstream ss;
+    ss << fsCode.substr(0, jsonEnd) << "\n";
+    for (auto& constant : constants) {
+      ss << "#define " << constant.first << " " << constant.second << "\n";
+    }
+    ss << fsCode.substr(jsonEnd);
+
+    return ss.str();
+  }
+
+ protected:
+  string _fsCode, _vsCode;
+  bool _fusesAEConversion = false;
+  float _multiplier16bit = 1.0f;
+  Rect _scissorRect = Rect(0, 0, 0, 0);
+  Rect _tileRect = Rect(0, 0, 0, 0);
+  Size _tileOutputSize = Size(0, 0);
+  bool _offsetsFragCoord = false;
+  bool _transformsTile = false;
+  size_t _programBytes = 0;
+  // Shared with the clones, which decrement the counter of the scene they're cloned from on destruction.
+  shared_ptr<atomic<size_t>> _numClones = make_shared<atomic<size_t>>(0);
+  shared_ptr<atomic<size_t>> _cloneOf;
+  shared_ptr<ProgramBinaryCache> _programBinaryCache;
+  ShaderManifest _manifest;
+
+  static ShaderManifest _analyzeCode(const string& fsCode, const string& vsCode, const ShaderManifest* manifest) {
+    if (manifest) {
+      return *manifest;
+    }
+
+    ShaderManifest analyzed;
+    analyzed.analyze(fsCode);
+    analyzed.analyze(vsCode);
+    analyzed.samplingMargins = _parseSamplingMargins(fsCode);
+
+    return analyzed;
+  }
+
+  // The passes are declared in the JSON, which is parsed by the document
+  static void _analyzePasses(ISFDoc& doc, ShaderManifest* manifest) {
+    manifest->numPasses = doc.renderPasses().size();
+    manifest->hasPersistentBuffers = !doc.persistentBuffers().empty();
+  }
+
+  static ISFDocRef _createDoc(const string& fsCode, const string& vsCode) {
     if (vsCode.empty()) {
-      doc = CreateISFDocRefWith(fsCode);
+      return CreateISFDocRefWith(fsCode);
     } else {
-      doc = CreateISFDocRefWith(fsCode, "/", vsCode);
+      return CreateISFDocRefWith(fsCode, "/", vsCode);
     }
-    useDoc(doc);
+  }
 
-    // Check if there's a redifinition of inputs with same name.
-    // this should precede the shader compilation since GLSL also raises redifinition error.
+  // Check if there's a redifinition of inputs with same name.
+  // this should precede the shader compilation since GLSL also raises redifinition error.
+  static void _checkInputNames(ISFDoc& doc) {
     unordered_set<string> inputNames;
-    for (auto& input : inputs()) {
+    for (auto& input : doc.inputs()) {
       string name = input->name();
       if (inputNames.find(name) != inputNames.end()) {
         map<string, string> errDict;
@@ -50,9 +317,67 @@ class ISF4AEScene : public ISFScene {
 
       inputNames.insert(name);
     }
+  }
+
+  void _compileProgram() {
+    if (!_programBinaryCache || !(_vsStringUpdated || _fsStringUpdated)) {
+      compileProgramIfNecessary();
+      return;
+    }
+
+    // The final sources include the code generated by VVISF, so they're the ones to be keyed.
+    auto digest = Hasher().update(_vsString).update(_fsString).digest128();
+
+    context()->makeCurrentIfNotCurrent();
+
+    GLuint program = _programBinaryCache->load(digest);
+
+    if (program == 0) {
+      compileProgramIfNecessary();
+
+      if (_errDict.empty()) {
+        _programBinaryCache->store(digest, _program);
+      }
+      return;
+    }
+
+    if (_program > 0) {
+      glDeleteProgram(_program);
+    }
+    _program = program;
+    _vsStringUpdated = false;
+    _fsStringUpdated = false;
+    _errDict.clear();
+
+    // The locations cached for the previous program are no longer valid
+    for (auto& input : inputs()) {
+      input->clearUniformLocations();
+    }
+  }
+
+  void _useDoc(const string& fsCode, const string& vsCode) {
+    auto doc = _createDoc(fsCode, vsCode);
+    useDoc(doc);
+
+    _analyzePasses(*doc, &_manifest);
+    _checkInputNames(*doc);
+  }
+
+  void _useCode(const string& fsCode, const string& vsCode) {
+    _useDoc(fsCode, vsCode);
 
     // Then complie
-    compileProgramIfNecessary();
+    _compileProgram();
+
+    // The size of the binary is the closest estimate of the memory held by the driver for the program
+    _programBytes = fsCode.size() + vsCode.size();
+#ifdef GL_PROGRAM_BINARY_LENGTH
+    GLint binaryLength = 0;
+    glGetProgramiv(program(), GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength > 0) {
+      _programBytes = binaryLength;
+    }
+#endif
 
     // Throw GLSL errors
     if (_errDict.size() > 0) {
@@ -74,28 +399,239 @@ class ISF4AEScene : public ISFScene {
     }
   }
 
-  map<string, string> errDict() { return _errDict; }
+  /**
+   * Rewrites the fragment shader to read and write pixels in AE's layout: IMG_* functions sampling image inputs are
+   * wrapped by i4a_fromAE(), and the original main() is renamed so that the last pass converts gl_FragColor by
+   * i4a_toAE(). The swizzle and the 16-bit scaling are done in the shader, while the origin offset and the vertical flip
+   * are left to the source rect of each input buffer. The helpers are inserted in the same line as the end of the JSON
+   * blob so that line numbers in error logs still match.
+   */
+  string _injectAEConversion(const string& fsCode) {
+    auto doc = CreateISFDocRefWith(fsCode);
 
-  bool isTimeDependant() {
-    string& fs = *doc()->fragShaderSource();
+    auto jsonEnd = fsCode.find("*/");
+    if (jsonEnd == string::npos) {
+      throw ISFErr(ISFErrType_ErrorLoading, "Invalid ISF", "", map<string, string>());
+    }
+    jsonEnd += 2;
 
-    // TODO: Regex below is quite makeshift and should be refactored.
-    regex re("TIME|TIMEDELTA|FRAMEINDEX|DATE");
+    unordered_set<string> imageNames;
+    for (auto& input : doc->inputs()) {
+      if (input->type() == ISFValType_Image) {
+        imageNames.insert(input->name());
+      }
+    }
+
+    string glsl = _wrapImageSampling(fsCode.substr(jsonEnd), imageNames);
+    glsl = regex_replace(glsl, regex(R"(\bvoid\s+main\s*\()"), "void i4a_main(");
+
+    stringstream ss;
+    ss << fsCode.substr(0, jsonEnd);
+    ss << "uniform float i4a_Multiplier16bit; ";
+    ss << "vec4 i4a_fromAE(vec4 c) { return c.gbar * i4a_Multiplier16bit; } ";
+    ss << "vec4 i4a_toAE(vec4 c) { return c.argb / i4a_Multiplier16bit; }";
+    ss << glsl << "\n";
+    ss << "void main() {\n";
+    ss << "  i4a_main();\n";
+    ss << "  if (PASSINDEX == " << (doc->renderPasses().size() > 0 ? doc->renderPasses().size() - 1 : 0) << ") {\n";
+    ss << "    gl_FragColor = i4a_toAE(gl_FragColor);\n";
+    ss << "  }\n";
+    ss << "}\n";
 
-    return regex_search(fs, re);
+    return ss.str();
   }
 
-  string getFragCode() {
-    auto doc = this->doc();
+  /**
+   * Replaces gl_FragCoord with the one offset by the origin of the tile, so that it keeps referring to the pixel in
+   * the whole output while rendering a tile. The uniform is inserted in the same line as the end of the JSON blob as
+   * well. The code is returned as it is when it doesn't use gl_FragCoord.
+   */
+  static string _injectFragCoordOffset(const string& fsCode) {
+    auto jsonEnd = fsCode.find("*/");
+    regex fragCoordRe(R"(\bgl_FragCoord\b)");
 
-    return *doc->jsonSourceString() + *doc->fragShaderSource();
+    if (jsonEnd == string::npos || !regex_search(fsCode.cbegin() + jsonEnd, fsCode.cend(), fragCoordRe)) {
+      return fsCode;
+    }
+    jsonEnd += 2;
+
+    stringstream ss;
+    ss << fsCode.substr(0, jsonEnd);
+    ss << "uniform vec2 i4a_FragCoordOffset; ";
+    ss << regex_replace(fsCode.substr(jsonEnd), fragCoordRe, "(gl_FragCoord + vec4(i4a_FragCoordOffset, 0.0, 0.0))");
+
+    return ss.str();
+  }
+
+  /**
+   * Renames main() of the vertex shader and calls it from a new main(), which maps the quad covering the whole output onto
+   * the tile being rendered. As it's done after the original main(), isf_FragNormCoord and the texture coordinates are
+   * still computed for the whole output. The passthrough shader is wrapped when the code is empty. The code is returned
+   * as it is if main() isn't found.
+   */
+  static string _injectTileTransform(const string& vsCode, bool* injected) {
+    string code = vsCode.empty() ? "void main() {\n  isf_vertShaderInit();\n}\n" : vsCode;
+    regex mainRe(R"(\bvoid\s+main\s*\()");
+
+    *injected = regex_search(code, mainRe);
+
+    if (!*injected) {
+      return vsCode;
+    }
+
+    stringstream ss;
+    ss << regex_replace(code, mainRe, "void i4a_main(", regex_constants::format_first_only);
+    ss << "\nuniform vec4 i4a_TileTransform;\n";
+    ss << "void main() {\n";
+    ss << "  i4a_main();\n";
+    ss << "  gl_Position.xy = gl_Position.xy * i4a_TileTransform.xy + i4a_TileTransform.zw * gl_Position.w;\n";
+    ss << "}\n";
+
+    return ss.str();
+  }
+
+  static string _wrapImageSampling(const string& glsl, const unordered_set<string>& imageNames) {
+    regex re(R"(\bIMG_(THIS_)?(NORM_)?PIXEL\s*\()");
+    smatch m;
+
+    string result;
+    size_t pos = 0;
+
+    while (regex_search(glsl.cbegin() + pos, glsl.cend(), m, re)) {
+      size_t start = pos + m.position(0);
+      size_t argsStart = start + m.length(0);
+
+      // Find the matching parenthesis
+      size_t end = argsStart;
+      int depth = 1;
+      while (end < glsl.size() && depth > 0) {
+        if (glsl[end] == '(') {
+          depth++;
+        } else if (glsl[end] == ')') {
+          depth--;
+        }
+        end++;
+      }
+
+      string args = glsl.substr(argsStart, end - argsStart);
+      string name = regex_replace(args.substr(0, args.find_first_of(",)")), regex(R"(^\s+|\s+$)"), "");
+
+      // Arguments may sample images as well
+      string call = glsl.substr(start, argsStart - start) + _wrapImageSampling(args, imageNames);
+
+      result += glsl.substr(pos, start - pos);
+      result += imageNames.count(name) > 0 ? "i4a_fromAE(" + call + ")" : call;
+
+      pos = end;
+    }
+
+    result += glsl.substr(pos);
+
+    return result;
+  }
+
+  /**
+   * Reads "I4A_MARGIN" of each input in the JSON blob, which VVISF ignores as an unknown key.
+   */
+  static map<string, int> _parseSamplingMargins(const string& fsCode) {
+    map<string, int> margins;
+
+    auto jsonStart = fsCode.find("/*");
+    auto jsonEnd = fsCode.find("*/");
+    if (jsonStart == string::npos || jsonEnd == string::npos) {
+      return margins;
+    }
+
+    string json = fsCode.substr(jsonStart + 2, jsonEnd - jsonStart - 2);
+
+    smatch m;
+    if (!regex_search(json, m, regex(R"("INPUTS"\s*:\s*\[)"))) {
+      return margins;
+    }
+
+    regex nameRe(R"re("NAME"\s*:\s*"([^"]*)")re");
+    regex marginRe(R"("I4A_MARGIN"\s*:\s*([0-9]+(\.[0-9]*)?))");
+
+    // Split the array into objects by counting braces outside of strings
+    int depth = 0;
+    bool inString = false;
+    size_t objectStart = 0;
+
+    for (size_t i = m.position(0) + m.length(0); i < json.size(); i++) {
+      char c = json[i];
+
+      if (inString) {
+        if (c == '\\') {
+          i++;
+        } else if (c == '"') {
+          inString = false;
+        }
+      } else if (c == '"') {
+        inString = true;
+      } else if (c == '{') {
+        if (depth++ == 0) {
+          objectStart = i;
+        }
+      } else if (c == '}') {
+        if (--depth == 0) {
+          string object = json.substr(objectStart, i - objectStart + 1);
+          smatch nameMatch, marginMatch;
+
+          if (regex_search(object, nameMatch, nameRe) && regex_search(object, marginMatch, marginRe)) {
+            margins[nameMatch[1].str()] = (int)ceil(stod(marginMatch[1].str()));
+          }
+        }
+      } else if (c == ']' && depth == 0) {
+        break;
+      }
+    }
+
+    return margins;
   }
 
- protected:
   void _setUpRenderPrepCallback() {
-    this->setRenderPrepCallback([](const VVGL::GLScene& n, const bool inReshaped, const bool inPgmChanged) {
+    this->setRenderPrepCallback([this](const VVGL::GLScene& n, const bool inReshaped, const bool inPgmChanged) {
       // Prevent a result to be multiplied by alpha.
       glDisable(GL_BLEND);
+
+      if (_scissorRect.size.width > 0 && _scissorRect.size.height > 0) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(_scissorRect.origin.x, _scissorRect.origin.y, _scissorRect.size.width, _scissorRect.size.height);
+      } else {
+        glDisable(GL_SCISSOR_TEST);
+      }
+
+      auto& tile = _tileRect;
+      bool rendersTile = tile.size.width > 0 && tile.size.height > 0;
+
+      if (rendersTile) {
+        glViewport(0, 0, tile.size.width, tile.size.height);
+      }
+
+      if (_transformsTile) {
+        // Scales and translates the normalized device coordinates of the whole output to the ones of the tile
+        GLint location = glGetUniformLocation(n.program(), "i4a_TileTransform");
+        if (location >= 0) {
+          if (rendersTile) {
+            auto& size = _tileOutputSize;
+            glUniform4f(location, size.width / tile.size.width, size.height / tile.size.height, (size.width - 2 * tile.origin.x - tile.size.width) / tile.size.width,
+                        (size.height - 2 * tile.origin.y - tile.size.height) / tile.size.height);
+          } else {
+            glUniform4f(location, 1.0f, 1.0f, 0.0f, 0.0f);
+          }
+        }
+      }
+
+      if (_offsetsFragCoord) {
+        GLint location = glGetUniformLocation(n.program(), "i4a_FragCoordOffset");
+        if (location >= 0) {
+          glUniform2f(location, rendersTile ? tile.origin.x : 0.0f, rendersTile ? tile.origin.y : 0.0f);
+        }
+      }
+
+      if (_fusesAEConversion) {
+        glUniform1f(glGetUniformLocation(n.program(), "i4a_Multiplier16bit"), _multiplier16bit);
+      }
     });
   }
 };
@@ -52,6 +52,8 @@ static PF_Err DisposeArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsE
 
   isf->name.clear();
   isf->desc = nullptr;
+  isf->path.clear();
+  isf->pendingDesc = nullptr;
 
   suites.HandleSuite1()->host_unlock_handle(extra->u.dispose_func_params.arbH);
   suites.HandleSuite1()->host_dispose_handle(extra->u.dispose_func_params.arbH);
@@ -85,6 +87,9 @@ static PF_Err CopyArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsExtr
 
   dstIsf->name = srcIsf->name;
   dstIsf->desc = srcIsf->desc;
+  dstIsf->path = srcIsf->path;
+  dstIsf->watchedVersion = srcIsf->watchedVersion;
+  dstIsf->pendingDesc = srcIsf->pendingDesc;
 
   suites.HandleSuite1()->host_unlock_handle(srcH);
   suites.HandleSuite1()->host_unlock_handle(dstH);
@@ -114,7 +119,11 @@ static PF_Err CompareArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsE
     return PF_Err_INTERNAL_STRUCT_DAMAGED;
   }
 
-  bool isEqual = a->name == b->name && a->desc.get() == b->desc.get();
+  // The digests tell whether the codes are the same without comparing them. A placeholder differs from the compiled one
+  // so that the effect is rendered again once the compilation finishes.
+  auto aDesc = resolveSceneDesc(a->desc);
+  auto bDesc = resolveSceneDesc(b->desc);
+  bool isEqual = a->name == b->name && aDesc->digest == bDesc->digest && aDesc->compiled.valid() == bDesc->compiled.valid();
 
   PF_ArbCompareResult result = isEqual ? PF_ArbCompare_EQUAL : PF_ArbCompare_NOT_EQUAL;
 
@@ -126,6 +135,20 @@ static PF_Err CompareArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsE
   return err;
 }
 
+/**
+ * Returns the compressed codes of the shader, which are compressed only once per shader however many times the project
+ * is saved and however many instances use it.
+ */
+static const vector<char>& getFlatCode(SceneDesc& desc) {
+  call_once(desc.flatCodeOnce, [&desc]() {
+    string code = desc.fsCode + desc.vsCode;
+    desc.flatCode = LZ::compress(code.data(), code.size());
+    desc.flatCodeSize = desc.flatCode.size();
+  });
+
+  return desc.flatCode;
+}
+
 static PF_Err FlatSizeArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsExtra* extra) {
   if (extra->u.flat_size_func_params.refconPV != ARB_REFCON) {
     return PF_Err_INTERNAL_STRUCT_DAMAGED;
@@ -136,14 +159,9 @@ static PF_Err FlatSizeArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParams
   AEGP_SuiteHandler suites(in_data->pica_basicP);
   auto* isf = reinterpret_cast<ParamArbIsf*>(suites.HandleSuite1()->host_lock_handle(extra->u.flat_size_func_params.arbH));
 
-  string fsCode = isf->desc->scene->getFragCode();
-  string& vsCode = *isf->desc->scene->doc()->vertShaderSource();
-
-  if (vsCode == VVISF::ISFVertPassthru_GL2) {
-    vsCode = "";
-  }
+  auto& flatCode = getFlatCode(*isf->desc);
 
-  A_u_long size = (A_u_long)(sizeof(ParamArbIsfFlatV1) + (isf->name.size() + fsCode.size() + vsCode.size()) * sizeof(char));
+  A_u_long size = (A_u_long)FlatIsf::getV2Size(isf->name, flatCode);
 
   *(extra->u.flat_size_func_params.flat_data_sizePLu) = size;
 
@@ -161,61 +179,18 @@ static PF_Err FlattenArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsE
 
   AEGP_SuiteHandler suites(in_data->pica_basicP);
   auto* isf = reinterpret_cast<ParamArbIsf*>(suites.HandleSuite1()->host_lock_handle(extra->u.flatten_func_params.arbH));
-  ParamArbIsfFlatV1* dstHeader = (ParamArbIsfFlatV1*)extra->u.flatten_func_params.flat_dataPV;
   char* dstPV = (char*)extra->u.flatten_func_params.flat_dataPV;
 
-  string fsCode = isf->desc->scene->getFragCode();
-  string& vsCode = *isf->desc->scene->doc()->vertShaderSource();
-
-  if (vsCode == VVISF::ISFVertPassthru_GL2) {
-    vsCode = "";
-  }
+  auto& desc = *isf->desc;
+  auto& flatCode = getFlatCode(desc);
 
-  A_u_long nameSize = (A_u_long)isf->name.size();
-  A_u_long fsCodeSize = (A_u_long)fsCode.size();
-  A_u_long vsCodeSize = (A_u_long)vsCode.size();
-
-  dstHeader->magicNumber = ARB_ISF_FLAT_V1_MAGIC_NUMBER;
-  dstHeader->version = 1;
-  dstHeader->offsetName = sizeof(ParamArbIsfFlatV1);
-  dstHeader->offsetFragCode = dstHeader->offsetName + nameSize;
-  dstHeader->offsetVertCode = dstHeader->offsetFragCode + fsCodeSize;
-
-  memcpy(dstPV + dstHeader->offsetName, isf->name.c_str(), nameSize * sizeof(char));
-  memcpy(dstPV + dstHeader->offsetFragCode, fsCode.c_str(), fsCodeSize * sizeof(char));
-  memcpy(dstPV + dstHeader->offsetVertCode, vsCode.c_str(), vsCodeSize * sizeof(char));
+  FlatIsf::writeV2(dstPV, isf->name, flatCode, desc.fsCode.size(), desc.vsCode.size(), desc.digest);
 
   suites.HandleSuite1()->host_unlock_handle(extra->u.flatten_func_params.arbH);
 
   return err;
 }
 
-static void UnflattenArbV0(GlobalData* globalData, char* flatData, A_u_long bufSize, ParamArbIsf* isf) {
-  // Find an offset of '\0' to split name and code
-  uint32_t nameSize = 0;
-  for (nameSize = 0;; nameSize++) {
-    if (flatData[nameSize] == '\0')
-      break;
-  }
-
-  auto fsCode = string(flatData + nameSize + 1, bufSize - (nameSize + 1) * sizeof(char));
-
-  isf->name = string(flatData, nameSize * sizeof(char));
-  isf->desc = getCompiledSceneDesc(globalData, fsCode, "");
-}
-
-static void UnflattenArbV1(GlobalData* globalData, char* flatData, A_u_long bufSize, ParamArbIsf* isf) {
-  ParamArbIsfFlatV1* flatHeader = reinterpret_cast<ParamArbIsfFlatV1*>(flatData);
-
-  isf->name = string(flatData + flatHeader->offsetName, flatHeader->offsetFragCode - flatHeader->offsetName);
-
-  auto fsCode = string(flatData + flatHeader->offsetFragCode, flatHeader->offsetVertCode - flatHeader->offsetFragCode);
-
-  auto vsCode = string(flatData + flatHeader->offsetVertCode, bufSize - flatHeader->offsetVertCode);
-
-  isf->desc = getCompiledSceneDesc(globalData, fsCode, vsCode);
-}
-
 static PF_Err UnflattenArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParamsExtra* extra) {
   if (extra->u.unflatten_func_params.refconPV != ARB_REFCON) {
     return PF_Err_INTERNAL_STRUCT_DAMAGED;
@@ -232,12 +207,24 @@ static PF_Err UnflattenArb(PF_InData* in_data, PF_OutData* out_data, PF_ArbParam
   auto* isf = reinterpret_cast<ParamArbIsf*>(suites.HandleSuite1()->host_lock_handle(arbH));
 
   char* flatData = (char*)extra->u.unflatten_func_params.flat_dataPV;
+  A_u_long bufSize = extra->u.unflatten_func_params.buf_sizeLu;
+
+  // The shader already loaded, such as the one shared by other instances or loaded before in the same session, is found
+  // by the digest without decompressing the codes
+  shared_ptr<SceneDesc> cachedDesc;
+
+  FlatIsf::Data flat;
+  bool isValid = FlatIsf::parse(flatData, bufSize, &flat, [globalData, &cachedDesc](const Digest128& digest) {
+    cachedDesc = globalData->scenes->get(digest);
+    return cachedDesc != nullptr;
+  });
 
-  if (flatData[0] != ARB_ISF_FLAT_V1_MAGIC_NUMBER) {
-    // Means version 0
-    UnflattenArbV0(globalData, flatData, extra->u.unflatten_func_params.buf_sizeLu, isf);
+  if (isValid) {
+    isf->name = flat.name;
+    isf->desc = flat.isCached ? cachedDesc : getCompiledSceneDesc(globalData, flat.fsCode, flat.vsCode);
   } else {
-    UnflattenArbV1(globalData, flatData, extra->u.unflatten_func_params.buf_sizeLu, isf);
+    // Keep the default arb rather than failing to open the whole project
+    FX_LOG("The flattened ISF parameter is corrupted, and is replaced by the default one.");
   }
 
   suites.HandleSuite1()->host_unlock_handle(arbH);
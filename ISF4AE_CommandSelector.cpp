@@ -10,8 +10,10 @@
 #include "MiscUtil.h"
 
 #include <VVGL.hpp>
+#include <chrono>
 #include <iostream>
 #include <mutex>
+#include <thread>
 
 #define GL_SILENCE_DEPRECATION
 #define MIN_SAFE_FLOAT -1000000
@@ -36,7 +38,7 @@ static PF_Err About(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* param
   auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
 
   auto desc = isf->desc;
-  auto& doc = *desc->scene->doc();
+  auto& doc = *desc->doc;
 
   stringstream ss;
 
@@ -45,6 +47,12 @@ static PF_Err About(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* param
   ss << "Description: " << doc.description() << endl;
   ss << "Credit: " << doc.credit() << endl;
 
+  // Tells how many shaders the lazy compilation has saved, which is also shown in release builds
+  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+  auto& stats = *globalData->compileStats;
+  ss << "Shaders compiled in the session: " << stats.numCompiled << " of " << stats.numRegistered << " loaded" << endl;
+  suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
   ss << endl;
 
   ss << "----------------" << endl;
@@ -72,7 +80,10 @@ static PF_Err PopDialog(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* p
 
   seqData->showISFOption = !seqData->showISFOption;
 
-  ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, Param_ISF, seqData->showISFOption));
+  AEUtil::EffectStreams streams(globalData->aegpId, in_data);
+  ERR(AEUtil::setParamVisibility(streams, in_data, params, Param_ISF, seqData->showISFOption));
+
+  seqData->paramUIStates[Param_ISF].visibility = seqData->showISFOption ? ParamVisibility_Visible : ParamVisibility_Hidden;
 
   suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
   suites.HandleSuite1()->host_unlock_handle(in_data->sequence_data);
@@ -121,9 +132,6 @@ static PF_Err GlobalSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef*
 #endif
   VVGL::CreateGlobalBufferPool(globalData->context->newContextSharingMe());
 
-  globalData->downloader = VVGL::CreateGLTexToCPUCopierRefUsing(globalData->context->newContextSharingMe());
-  globalData->uploader = VVGL::CreateGLCPUToTexCopierRefUsing(globalData->context->newContextSharingMe());
-
   FX_LOG("OpenGL Version:       " << glGetString(GL_VERSION));
   FX_LOG("OpenGL Vendor:        " << glGetString(GL_VENDOR));
   FX_LOG("OpenGL Renderer:      " << glGetString(GL_RENDERER));
@@ -132,30 +140,64 @@ static PF_Err GlobalSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef*
   // Setup GL objects
   string resourcePath = AEUtil::getResourcesPath(in_data);
 
+  globalData->context->makeCurrentIfNotCurrent();
+  globalData->programBinaryCache = make_shared<ProgramBinaryCache>(SystemUtil::getCacheDirectory(), ProgramBinaryCacheBytes);
+
   globalData->defaultScene = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
 
   globalData->defaultScene->useCode(SystemUtil::readResourceShader(IDR_DEFAULT_FS), "");
 
-  globalData->ae2glScene = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
-  globalData->ae2glScene->useCode(SystemUtil::readResourceShader(IDR_AE2GL_FS), "");
+  // Render contexts are created on demand, up to the number of threads that AE may render frames concurrently.
+  auto sharedContext = globalData->context;
+  string ae2glCode = SystemUtil::readResourceShader(IDR_AE2GL_FS);
+  string gl2aeCode = SystemUtil::readResourceShader(IDR_GL2AE_FS);
+  size_t numRenderContexts = min((size_t)MaxRenderContexts, (size_t)thread::hardware_concurrency());
 
-  globalData->gl2aeScene = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
-  globalData->gl2aeScene->useCode(SystemUtil::readResourceShader(IDR_GL2AE_FS), "");
+  // Frames are already rendered in parallel, so it leaves a thread for the caller of each conversion.
+  globalData->threadPool = make_shared<ThreadPool>(max(1u, thread::hardware_concurrency()) - 1);
+  auto* threadPool = globalData->threadPool.get();
+
+  globalData->compileStats = make_shared<CompileStats>();
+  globalData->fileWatcher = make_shared<FileWatcher>(chrono::milliseconds(FileWatchInterval));
+  globalData->compileQueue = make_shared<ThreadPool>(min((size_t)MaxCompileThreads, max<size_t>(thread::hardware_concurrency(), 1)));
+
+  FX_LOG("Pixel conversion kernel: " << PixelConvert::getKernelName());
+
+  globalData->renderContexts = make_shared<ResourcePool<RenderContext>>(
+      [sharedContext, ae2glCode, gl2aeCode, threadPool]() { return createRenderContext(sharedContext, ae2glCode, gl2aeCode, threadPool); },
+      numRenderContexts);
+
+  // Create the first one in advance so that the shaders for conversion are compiled at launch
+  globalData->renderContexts->checkin(globalData->renderContexts->checkout());
 
   // Without this USELESS variable I'm getting a glitch, where the scene
   // doesn't work without any errors
   // FIXME: Dig into it to figure it out the reason
   ISF4AESceneRef useless = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
 
-  globalData->scenes = make_shared<WeakMap<string, SceneDesc>>();
+  auto* defaultScene = globalData->defaultScene.get();
+  auto estimateSceneDescSize = [defaultScene](const SceneDesc& desc) {
+    size_t size = sizeof(SceneDesc) + desc.status.size() + desc.errorLog.size();
+    size += desc.fsCode.size() + desc.vsCode.size() + desc.flatCodeSize;
 
-#ifndef _WIN32
-  globalData->lock = [[NSLock alloc] init];
-#endif
+    // The default scene is shared by the shaders failed to compile. Each render context that has rendered the shader
+    // holds a clone of the scene as long as the scene is alive, which is charged as much as the scene itself.
+    if (desc.scene && desc.scene.get() != defaultScene) {
+      size += desc.scene->estimateMemoryUsage() * (1 + desc.scene->numClones());
+    }
+
+    return size;
+  };
+
+  globalData->scenes = make_shared<LRUCache<Digest128, SceneDesc, Digest128Hash>>(estimateSceneDescSize, SceneCacheBytes);
+
+  globalData->frameCache = make_shared<FrameCache>(FrameCacheBytes);
 
   auto notLoadedSceneDesc = make_shared<SceneDesc>();
   notLoadedSceneDesc->status = "Not Loaded";
   notLoadedSceneDesc->scene = globalData->defaultScene;
+  notLoadedSceneDesc->doc = globalData->defaultScene->doc();
+  notLoadedSceneDesc->manifest = globalData->defaultScene->manifest();
 
   globalData->notLoadedSceneDesc = notLoadedSceneDesc;
 
@@ -176,17 +218,24 @@ static PF_Err GlobalSetdown(PF_InData* in_data, PF_OutData* out_data, PF_ParamDe
     // TODO: Find a way not to call destructors explicitly
     auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
 
+    // Wait for the shaders being compiled, which refer to the other members
+    globalData->compileQueue = nullptr;
+
+    auto& stats = *globalData->compileStats;
+    FX_LOG("Shaders never compiled in the session: " << (stats.numRegistered - stats.numCompiled) << " of " << stats.numRegistered);
+    globalData->compileStats = nullptr;
+    globalData->fileWatcher = nullptr;
+
     globalData->context = nullptr;
-    globalData->uploader = nullptr;
-    globalData->downloader = nullptr;
     globalData->defaultScene = nullptr;
-    globalData->gl2aeScene = nullptr;
-    globalData->ae2glScene = nullptr;
+    globalData->renderContexts = nullptr;
+    globalData->threadPool = nullptr;
+
+    FX_LOG("Frame cache in the session: hits=" << globalData->frameCache->hits() << ", misses=" << globalData->frameCache->misses());
+    globalData->frameCache = nullptr;
     globalData->notLoadedSceneDesc = nullptr;
     globalData->scenes = nullptr;
-#ifndef _WIN32
-    globalData->lock = nil;
-#endif  // !_WIN32
+    globalData->programBinaryCache = nullptr;
     suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
     suites.HandleSuite1()->host_dispose_handle(in_data->global_data);
   }
@@ -205,6 +254,7 @@ static PF_Err SequenceSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDe
 
   auto* seq = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(seqH));
 
+  AEFX_CLR_STRUCT(*seq);
   seq->showISFOption = true;
 
   out_data->sequence_data = seqH;
@@ -220,15 +270,16 @@ static PF_Err SequenceFlatten(PF_InData* in_data, PF_OutData* out_data, PF_Param
 
   auto unflatSeq = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(in_data->sequence_data));
 
-  PF_Handle flatSeqH = suites.HandleSuite1()->host_new_handle(sizeof(SequenceData));
+  PF_Handle flatSeqH = suites.HandleSuite1()->host_new_handle(sizeof(FlatSequenceData));
 
   if (!flatSeqH) {
     return PF_Err_OUT_OF_MEMORY;
   }
 
-  auto flatSeq = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(flatSeqH));
+  auto flatSeq = reinterpret_cast<FlatSequenceData*>(suites.HandleSuite1()->host_lock_handle(flatSeqH));
 
   flatSeq->showISFOption = unflatSeq->showISFOption;
+  memcpy(flatSeq->isParamConstant, unflatSeq->isParamConstant, sizeof(flatSeq->isParamConstant));
 
   suites.HandleSuite1()->host_unlock_handle(flatSeqH);
   suites.HandleSuite1()->host_unlock_handle(in_data->sequence_data);
@@ -242,7 +293,7 @@ static PF_Err SequenceRestart(PF_InData* in_data, PF_OutData* out_data, PF_Param
   PF_Err err = PF_Err_NONE;
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
-  auto flatSeq = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(in_data->sequence_data));
+  auto flatSeq = reinterpret_cast<FlatSequenceData*>(suites.HandleSuite1()->host_lock_handle(in_data->sequence_data));
 
   PF_Handle unflatSeqH = suites.HandleSuite1()->host_new_handle(sizeof(SequenceData));
 
@@ -252,8 +303,14 @@ static PF_Err SequenceRestart(PF_InData* in_data, PF_OutData* out_data, PF_Param
 
   auto unflatSeq = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(unflatSeqH));
 
+  AEFX_CLR_STRUCT(*unflatSeq);
   unflatSeq->showISFOption = flatSeq->showISFOption;
 
+  // The projects saved by the older versions don't have the flags, which are then found by the next UpdateParamsUI
+  if (suites.HandleSuite1()->host_get_handle_size(in_data->sequence_data) >= sizeof(FlatSequenceData)) {
+    memcpy(unflatSeq->isParamConstant, flatSeq->isParamConstant, sizeof(unflatSeq->isParamConstant));
+  }
+
   suites.HandleSuite1()->host_unlock_handle(unflatSeqH);
   suites.HandleSuite1()->host_unlock_handle(in_data->sequence_data);
 
@@ -386,32 +443,36 @@ static PF_Err ParamsSetup(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef*
   return err;
 }
 
+/**
+ * Called by AE to free the pre-render data, whether or not the frame has been rendered by SmartRender.
+ */
+static void DeletePreRenderData(void* preRenderData) {
+  delete reinterpret_cast<PreRenderData*>(preRenderData);
+}
+
+/**
+ * Tells if the frame is rendered for the previews in the UI, which are refreshed by the idle event once the shader is
+ * compiled. The frames rendered in a render-only project, such as by the render queue, aerender and Media Encoder, are
+ * written as they are, so they have to wait for the shader.
+ */
+static bool isInteractiveRender(PF_InData* in_data) {
+  return !(in_data->in_flags & PF_InFlag_PROJECT_IS_RENDER_ONLY);
+}
+
 static PF_Err SmartPreRender(PF_InData* in_data, PF_OutData* out_data, PF_PreRenderExtra* extra) {
   PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
-  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
-
-#ifndef _WIN32
-  [globalData->lock lock];
-#endif  // !_WIN32
-
-  // Create preRenderData
-  PF_Handle preRenderDataH = suites.HandleSuite1()->host_new_handle(sizeof(PreRenderData));
-
-  if (!preRenderDataH) {
-    return PF_Err_OUT_OF_MEMORY;
-  }
-
-  // Set handler
-  extra->output->pre_render_data = preRenderDataH;
-
-  auto* preRenderData = reinterpret_cast<PreRenderData*>(suites.HandleSuite1()->host_lock_handle(preRenderDataH));
+  // Create preRenderData, which holds the reference to the scene until AE deletes it
+  auto* preRenderData = new (nothrow) PreRenderData();
 
   if (!preRenderData) {
     return PF_Err_OUT_OF_MEMORY;
   }
 
+  extra->output->pre_render_data = preRenderData;
+  extra->output->delete_pre_render_data_func = DeletePreRenderData;
+
   PF_ParamDef paramDef;
 
   // Get the ISF scene from cache and save its pointer to PreRenderData
@@ -422,32 +483,103 @@ static PF_Err SmartPreRender(PF_InData* in_data, PF_OutData* out_data, PF_PreRen
     auto* isf = reinterpret_cast<ParamArbIsf*>(*paramDef.u.arb_d.value);
 
     if (isf) {
-      auto desc = isf->desc;
+      auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+      auto desc = requestCompiledSceneDesc(globalData, isf->desc);
+
+      if (desc->compiled.valid()) {
+        if (isInteractiveRender(in_data)) {
+          // Render the default shader until the compilation finishes. Then the effect is refreshed by the idle event.
+          desc = globalData->notLoadedSceneDesc;
+        } else {
+          desc = desc->compiled.get();
+        }
+      }
+
+      auto renderedDesc = desc;
+
+#if SPECIALIZE_CONSTANT_INPUTS
+      if (in_data->appl_id != 'PrMr' && desc->scene != globalData->defaultScene) {
+        // Render threads only have the const copy of the sequence data
+        AEFX_SuiteScoper<PF_EffectSequenceDataSuite1> seqDataSuite(in_data, kPFEffectSequenceDataSuite, kPFEffectSequenceDataSuiteVersion1, out_data);
+        PF_ConstHandle seqDataH = nullptr;
 
-      preRenderData->scene = desc->scene.get();
+        if (!seqDataSuite->PF_GetConstSequenceData(in_data->effect_ref, &seqDataH) && seqDataH) {
+          auto* seqData = reinterpret_cast<const SequenceData*>(*seqDataH);
+
+          map<string, string> constants;
+          getConstantInputValues(in_data, out_data, *seqData, *desc->scene, &constants);
+          renderedDesc = getSpecializedSceneDesc(globalData, desc, constants);
+        }
+      }
+#endif
+
+      suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
+      preRenderData->scene = renderedDesc->scene;
+      // The variant renders the same image as the generic one, so the frames cached by either can be reused.
+      preRenderData->sceneDigest = desc->digest;
+
+      // Let AE tell the frames of the default shader from the compiled one, so that it doesn't reuse the cached frames
+      // rendered while compiling.
+      ERR(extra->cb->GuidMixInPtr(in_data->effect_ref, sizeof(preRenderData->sceneDigest), &preRenderData->sceneDigest));
     }
 
     ERR2(PF_CHECKIN_PARAM(in_data, &paramDef));
   }
 
+  auto& scene = preRenderData->scene;
+
+  // Compute the rect to render. The output region is an entire layer multiplied by downsample, regardless of input's
+  // mask.
+  PF_Rect layerRect = {0, 0, (A_long)ceil((double)in_data->width * in_data->downsample_x.num / in_data->downsample_x.den),
+                       (A_long)ceil((double)in_data->height * in_data->downsample_y.num / in_data->downsample_y.den)};
+
+  PF_Rect renderRect = layerRect;
+
+  if (scene->canRenderRegion()) {
+    // Only render the requested region when each pixel can be computed from the inputs around it
+    auto& requestRect = extra->input->output_request.rect;
+
+    renderRect.left = max(layerRect.left, requestRect.left);
+    renderRect.top = max(layerRect.top, requestRect.top);
+    renderRect.right = max(renderRect.left, min(layerRect.right, requestRect.right));
+    renderRect.bottom = max(renderRect.top, min(layerRect.bottom, requestRect.bottom));
+  }
+
   // Checkout all image parameters
   PF_CheckoutResult inResult;
 
   int userParamIndex = 0;
 
-  PF_RenderRequest req = extra->input->output_request;
-  req.rect.left = 0;
-  req.rect.top = 0;
-  req.rect.right = 10000;
-  req.rect.bottom = 10000;
-  req.preserve_rgb_of_zero_alpha = true;
-
-  for (auto input : preRenderData->scene->inputs()) {
+  for (auto input : scene->inputs()) {
     UserParamType userParamType = getUserParamTypeForISFAttr(input);
 
     if (userParamType == UserParamType_Image) {
       PF_ParamIndex paramIndex = input->isFilterInputImage() ? Param_Input : getIndexForUserParam(userParamIndex, UserParamType_Image);
 
+      PF_RenderRequest req = extra->input->output_request;
+      req.preserve_rgb_of_zero_alpha = true;
+
+      int margin = scene->getSamplingMargin(input->name());
+
+      if (input->isFilterInputImage() && margin >= 0) {
+        // Request the pixels the region to render refers to. The margin is specified in full resolution.
+        A_long marginX = (A_long)ceil((double)margin * in_data->downsample_x.num / in_data->downsample_x.den);
+        A_long marginY = (A_long)ceil((double)margin * in_data->downsample_y.num / in_data->downsample_y.den);
+
+        req.rect.left = renderRect.left - marginX;
+        req.rect.top = renderRect.top - marginY;
+        req.rect.right = renderRect.right + marginX;
+        req.rect.bottom = renderRect.bottom + marginY;
+      } else {
+        // Other layers are mapped to the output by their own sizes, which are unknown until checked out, so request
+        // them entirely. AE clips the rect by the bounds of the layer.
+        req.rect.left = 0;
+        req.rect.top = 0;
+        req.rect.right = MaxCheckoutLayerSize;
+        req.rect.bottom = MaxCheckoutLayerSize;
+      }
+
       (extra->cb->checkout_layer(in_data->effect_ref,
                                  // A parameter index of layer to checkout
                                  paramIndex,
@@ -467,76 +599,44 @@ static PF_Err SmartPreRender(PF_InData* in_data, PF_OutData* out_data, PF_PreRen
     }
   }
 
-  // Compute the rect to render
   if (!err) {
-    // Set the output region to an entire layer multiplied by downsample, regardless of input's mask.
-    PF_Rect outputRect = {0, 0, (A_long)ceil((double)in_data->width * in_data->downsample_x.num / in_data->downsample_x.den),
-                          (A_long)ceil((double)in_data->height * in_data->downsample_y.num / in_data->downsample_y.den)};
-
-    UnionLRect(&outputRect, &extra->output->result_rect);
-    UnionLRect(&outputRect, &extra->output->max_result_rect);
+    extra->output->result_rect = renderRect;
+    extra->output->max_result_rect = layerRect;
 
-    preRenderData->outSize = VVGL::Size(outputRect.right, outputRect.bottom);
+    preRenderData->outSize = VVGL::Size(layerRect.right, layerRect.bottom);
+    preRenderData->renderRect = renderRect;
 
     extra->output->flags |= PF_RenderOutputFlag_RETURNS_EXTRA_PIXELS;
   }
 
-  suites.HandleSuite1()->host_unlock_handle(preRenderDataH);
-
-#ifndef _WIN32
-  [globalData->lock unlock];
-#endif  // !_WIN32
-
   return err;
 }
 
 static PF_Err SmartRender(PF_InData* in_data, PF_OutData* out_data, PF_SmartRenderExtra* extra) {
-  PF_Err err = PF_Err_NONE;
+  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
 
   AEGP_SuiteHandler suites(in_data->pica_basicP);
 
   auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
 
-#ifndef _WIN32
-  [globalData->lock lock];
-#endif  // !_WIN32
+  // Checkout a set of GL objects exclusively used by this thread
+  auto renderContext = globalData->renderContexts->checkout();
 
-  globalData->context->makeCurrentIfNotCurrent();
+  renderContext->context->makeCurrentIfNotCurrent();
 
-  auto preRenderDataH = reinterpret_cast<PF_Handle>(extra->input->pre_render_data);
-
-  auto* preRenderData = reinterpret_cast<PreRenderData*>(suites.HandleSuite1()->host_lock_handle(preRenderDataH));
+  auto* preRenderData = reinterpret_cast<PreRenderData*>(extra->input->pre_render_data);
 
   auto bitdepth = extra->input->bitdepth;
-  auto pixelBytes = bitdepth * 4 / 8;
-  auto& scene = preRenderData->scene;
+  auto scene = getSceneForRenderContext(*renderContext, preRenderData->scene);
 
-  // It has to be done by callee to bind all of layer inputs, before calling renderISFToCPUBuffer
-  int userParamIndex = 0;
-  for (auto& input : preRenderData->scene->inputs()) {
-    if (input->type() == VVISF::ISFValType_Image) {
-      PF_ParamIndex checkoutIndex;
-      VVGL::Size layerSize;
-
-      if (input->isFilterInputImage()) {
-        checkoutIndex = Param_Input;
-        layerSize = preRenderData->outSize;
-      } else {
-        checkoutIndex = getIndexForUserParam(userParamIndex, UserParamType_Image);
-        layerSize = preRenderData->inputImageSizes[userParamIndex];
-      }
-
-      VVGL::GLBufferRef image;
-
-      ERR(uploadCPUBufferInSmartRender(globalData, in_data->effect_ref, extra, checkoutIndex, layerSize, image));
-
-      input->setCurrentImageBuffer(image);
-    }
-
-    if (isISFAttrVisibleInECW(input)) {
-      userParamIndex++;
-    }
-  }
+  auto& timings = renderContext->timings;
+  timings = RenderTimings();
+  auto stageStart = chrono::steady_clock::now();
+  auto endStage = [&stageStart](double& duration) {
+    auto now = chrono::steady_clock::now();
+    duration += chrono::duration<double, milli>(now - stageStart).count();
+    stageStart = now;
+  };
 
   // Bind special uniforms reserved for ISF4AE
   VVISF::ISFVal i4aDownsample =
@@ -544,48 +644,342 @@ static PF_Err SmartRender(PF_InData* in_data, PF_OutData* out_data, PF_SmartRend
   scene->setValueForInputNamed(i4aDownsample, "i4a_Downsample");
   scene->setValueForInputNamed(VVISF::ISFVal(VVISF::ISFValType_Bool, false), "i4a_CustomUI");
 
-  // Render
-  VVGL::GLBufferRef outputImageCPU = nullptr;
   VVGL::Size pointScale = {1.0, 1.0};
-  renderISFToCPUBuffer(in_data, out_data, *scene, bitdepth, preRenderData->outSize, pointScale, &outputImageCPU);
+  double time = 0;
+  ERR(setISFInputValues(in_data, out_data, *scene, preRenderData->outSize, pointScale, &time));
+
+  auto& renderRect = preRenderData->renderRect;
+  size_t renderWidth = renderRect.right - renderRect.left;
+  size_t renderHeight = renderRect.bottom - renderRect.top;
+
+  // Look up the frame rendered from the same code and values. Only the frames of shaders that don't depend on time are
+  // cached, since they're the ones reused at other times while scrubbing, and AE caches the frame at the same time by
+  // itself. The state of params given by AE doesn't change with footage playing in the layers upstream, so the time
+  // the layers are checked out at is added to the key when the shader has any image input.
+  PF_State paramsState;
+  AEFX_CLR_STRUCT(paramsState);
+
+  A_Time frameStart = {in_data->current_time, (A_u_long)in_data->time_scale};
+  A_Time frameDuration = {in_data->time_step, (A_u_long)in_data->time_scale};
+
+  bool usesFrameCache = !err && !scene->isTimeDependant() &&
+                        !suites.ParamUtilsSuite3()->PF_GetCurrentState(in_data->effect_ref, PF_ParamIndex_CHECK_ALL, &frameStart, &frameDuration, &paramsState);
+
+  uint64_t frameKey = 0;
+  shared_ptr<const FrameCache::Frame> cachedFrame = nullptr;
+
+  if (usesFrameCache) {
+    Hasher hasher;
+    hasher.add(preRenderData->sceneDigest);
+    hasher.add(paramsState);
+    hashISFInputValues(hasher, *scene);
+
+    for (auto& input : scene->inputs()) {
+      if (input->type() == VVISF::ISFValType_Image) {
+        hasher.add(frameStart);
+        hasher.add(frameDuration);
+        break;
+      }
+    }
 
-  // Check-in output pixels
-  PF_EffectWorld* outputWorld = nullptr;
-  ERR(extra->cb->checkout_output(in_data->effect_ref, &outputWorld));
+    hasher.add(in_data->downsample_x);
+    hasher.add(in_data->downsample_y);
+    hasher.add(bitdepth);
+    hasher.add(preRenderData->outSize.width);
+    hasher.add(preRenderData->outSize.height);
+    hasher.add(renderRect);
+
+    frameKey = hasher.digest();
+    cachedFrame = globalData->frameCache->get(frameKey);
+  }
+
+  // It has to be done by callee to bind all of layer inputs, before calling renderISFToTexture
+  if (!cachedFrame) {
+    int userParamIndex = 0;
+
+    for (auto& input : scene->inputs()) {
+      if (input->type() == VVISF::ISFValType_Image) {
+        PF_ParamIndex checkoutIndex = Param_Input;
+        VVGL::Size size = preRenderData->outSize;
 
-  if (outputWorld) {
-    // Download
-    char* glP = nullptr;  // Pointer offset for OpenGL buffer
-    char* aeP = nullptr;  // for AE's layerDef
+        if (!input->isFilterInputImage()) {
+          checkoutIndex = getIndexForUserParam(userParamIndex, UserParamType_Image);
+          size = preRenderData->inputImageSizes[userParamIndex];
+        }
+
+        PF_LayerDef* layerDef = nullptr;
+        ERR(extra->cb->checkout_layer_pixels(in_data->effect_ref, checkoutIndex, &layerDef));
 
-    auto bytesPerRowGl = outputImageCPU->calculateBackingBytesPerRow();
+        VVGL::GLBufferRef image;
+        ERR(uploadCPUBufferInSmartRender(*renderContext, layerDef, bitdepth, size, scene->fusesAEConversion(), image));
 
-    if (!outputImageCPU->cpuBackingPtr) {
-      err = PF_Err_OUT_OF_MEMORY;
-      // A more explicit assert that appears with the new versions
-      // of the Nvidia Studio driver described in this post:
-      // [link](https://github.com/baku89/ISF4AE/issues/19#issuecomment-1724631129)
-      assert("FATAL! CPU backing pointer is NULL! Cannot copy CPU buffer to EffectWorld!" && false);
+        input->setCurrentImageBuffer(image);
+
+        ERR2(extra->cb->checkin_layer_pixels(in_data->effect_ref, checkoutIndex));
+      }
+
+      if (isISFAttrVisibleInECW(input)) {
+        userParamIndex++;
+      }
     }
+  }
 
-    // Copy per row
-    for (size_t y = 0; y < preRenderData->outSize.height; y++) {
-      glP = (char*)outputImageCPU->cpuBackingPtr + y * bytesPerRowGl;
-      aeP = (char*)outputWorld->data + y * outputWorld->rowbytes;
-      memcpy(aeP, glP, preRenderData->outSize.width * pixelBytes);
+  endStage(timings.upload);
+
+  PF_EffectWorld* outputWorld = nullptr;
+
+  if (cachedFrame) {
+    ERR(extra->cb->checkout_output(in_data->effect_ref, &outputWorld));
+
+    if (outputWorld) {
+      copyFrameToEffectWorld(*cachedFrame, outputWorld);
     }
+
+    endStage(timings.copy);
+
   } else {
-    FX_LOG("Cannot checkout outputWorld");
+    // Render
+    VVGL::GLBufferRef outputImage = nullptr;
+
+    A_long tileWidth = 0, tileHeight = 0;
+    bool rendersTiled = renderWidth > 0 && renderHeight > 0 &&
+                        getTileSize(*renderContext, *scene, bitdepth, preRenderData->outSize, &tileWidth, &tileHeight);
+
+    ReadbackBuffer* readback = nullptr;
+
+    if (rendersTiled) {
+      // Stream each tile to the output world while the next one is being rendered. As the readback buffers are cycled,
+      // the one for the previous tile is copied before it's reused.
+      ERR(extra->cb->checkout_output(in_data->effect_ref, &outputWorld));
+
+      if (outputWorld) {
+        PF_Rect pendingTile = {0, 0, 0, 0};
+
+        auto copyPendingTile = [&]() -> PF_Err {
+          const char* pixels = mapReadback(*readback);
+          endStage(timings.readback);
+
+          if (!pixels) {
+            return PF_Err_OUT_OF_MEMORY;
+          }
+
+          copyReadbackToEffectWorld(*renderContext, *readback, pixels, convertsAEFormatOnCPU(*renderContext, *scene), bitdepth, pendingTile.left - renderRect.left,
+                                    pendingTile.top - renderRect.top, outputWorld);
+          unmapReadback(*readback);
+          readback = nullptr;
+          endStage(timings.copy);
+
+          return PF_Err_NONE;
+        };
+
+        ERR(renderISFTiles(in_data, out_data, *renderContext, *scene, bitdepth, preRenderData->outSize, time, renderRect, tileWidth, tileHeight,
+                           [&](const PF_Rect& tile, const VVGL::GLBufferRef& texture, const PF_Rect& textureRect) {
+                             PF_Err tileErr = PF_Err_NONE;
+
+                             endStage(timings.render);
+                             auto& nextReadback = beginReadback(*renderContext, texture, bitdepth, textureRect);
+
+                             if (readback) {
+                               tileErr = copyPendingTile();
+                             }
+
+                             readback = &nextReadback;
+                             pendingTile = tile;
+
+                             return tileErr;
+                           }));
+
+        if (readback) {
+          ERR(copyPendingTile());
+        }
+
+        // Discard the tile left pending by an error
+        readback = nullptr;
+      }
+
+    } else if (renderWidth > 0 && renderHeight > 0) {
+      ERR(renderISFToTexture(in_data, out_data, *renderContext, *scene, bitdepth, preRenderData->outSize, time, renderRect, &outputImage));
+    }
+
+    // Restore the swizzle of inputs before they go back to the buffer pool
+    for (auto& input : scene->inputs()) {
+      if (input->type() == VVISF::ISFValType_Image && input->getCurrentImageBuffer()) {
+        setTextureSwizzleFromAE(input->getCurrentImageBuffer(), false);
+      }
+    }
+
+    endStage(timings.render);
+
+    if (!rendersTiled) {
+      // Rows that have to be reversed cannot be read into the output world directly, so start reading them back
+      // asynchronously and check-out output pixels while the GPU is copying.
+      if (outputImage && outputImage->flipped) {
+        readback = &beginReadback(*renderContext, outputImage, bitdepth, renderRect);
+      }
+
+      ERR(extra->cb->checkout_output(in_data->effect_ref, &outputWorld));
+
+      if (outputWorld && outputImage && !readback) {
+        if (!downloadTexToEffectWorld(*renderContext, outputImage, bitdepth, renderRect, outputWorld)) {
+          // Fall back to copying per row when the pitch of the world cannot be represented
+          readback = &beginReadback(*renderContext, outputImage, bitdepth, renderRect);
+        }
+      }
+
+      endStage(timings.readback);
+    }
+
+    if (!outputWorld) {
+      FX_LOG("Cannot checkout outputWorld");
+
+    } else if (readback) {
+      const char* pixels = mapReadback(*readback);
+      endStage(timings.readback);
+
+      if (!pixels) {
+        err = PF_Err_OUT_OF_MEMORY;
+        // A more explicit assert that appears with the new versions
+        // of the Nvidia Studio driver described in this post:
+        // [link](https://github.com/baku89/ISF4AE/issues/19#issuecomment-1724631129)
+        assert("FATAL! Mapped readback buffer is NULL! Cannot copy it to EffectWorld!" && false);
+      } else {
+        copyReadbackToEffectWorld(*renderContext, *readback, pixels, convertsAEFormatOnCPU(*renderContext, *scene), bitdepth, 0, 0, outputWorld);
+      }
+
+      unmapReadback(*readback);
+    }
+
+    // Keep the frame for rendering it again
+    if (!err && outputWorld && usesFrameCache) {
+      globalData->frameCache->set(frameKey, copyEffectWorldToFrame(outputWorld, renderWidth, renderHeight, bitdepth));
+    }
+
+    endStage(timings.copy);
   }
 
-  suites.HandleSuite1()->host_unlock_handle(preRenderDataH);
-  suites.HandleSuite1()->host_dispose_handle(preRenderDataH);
+  FX_LOG("SmartRender timings: upload=" << timings.upload << "ms, render=" << timings.render << "ms, readback=" << timings.readback
+                                        << "ms, copy=" << timings.copy << "ms");
+  FX_LOG("Frame cache: hits=" << globalData->frameCache->hits() << ", misses=" << globalData->frameCache->misses() << ", size=" << globalData->frameCache->size()
+                              << " bytes");
+
+  globalData->renderContexts->checkin(renderContext);
 
   suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
 
-#ifndef _WIN32
-  [globalData->lock unlock];
-#endif  // !_WIN32
+  return err;
+}
+
+// Counts how many parameter UI updates are issued through AEGP by UpdateParamsUI, and how many are skipped as applied.
+struct ParamsUIStats {
+  int numApplied = 0;
+  int numSkipped = 0;
+};
+
+static PF_Err applyParamVisibility(AEUtil::EffectStreams& streams,
+                                   PF_InData* in_data,
+                                   PF_ParamDef* params[],
+                                   SequenceData* seqData,
+                                   PF_ParamIndex index,
+                                   bool visible,
+                                   ParamsUIStats* stats) {
+  PF_Err err = PF_Err_NONE;
+
+  auto& state = seqData->paramUIStates[index];
+  auto visibility = visible ? ParamVisibility_Visible : ParamVisibility_Hidden;
+
+  if (state.visibility == visibility) {
+    stats->numSkipped++;
+    return err;
+  }
+
+  ERR(AEUtil::setParamVisibility(streams, in_data, params, index, visible));
+  stats->numApplied++;
+
+  state.visibility = err ? ParamVisibility_Unknown : visibility;
+
+  return err;
+}
+
+/**
+ * Returns the digest of the label and the options of the user param, which are set to the param by UpdateParamsUI.
+ */
+static uint64_t getParamUIDigest(const PF_ParamDef& param, UserParamType type, const string& label) {
+  Hasher hasher;
+  hasher.update(label);
+  hasher.update(&type, sizeof(type));
+
+  switch (type) {
+    case UserParamType_Bool:
+      hasher.update(&param.u.bd.dephault, sizeof(param.u.bd.dephault));
+      break;
+
+    case UserParamType_Long:
+      hasher.update(&param.u.pd.num_choices, sizeof(param.u.pd.num_choices));
+      hasher.update(&param.u.pd.dephault, sizeof(param.u.pd.dephault));
+      hasher.update(string(param.u.pd.u.namesptr));
+      break;
+
+    case UserParamType_Float: {
+      auto& fs = param.u.fs_d;
+      hasher.update(&fs.dephault, sizeof(fs.dephault));
+      hasher.update(&fs.slider_min, sizeof(fs.slider_min));
+      hasher.update(&fs.slider_max, sizeof(fs.slider_max));
+      hasher.update(&fs.valid_min, sizeof(fs.valid_min));
+      hasher.update(&fs.valid_max, sizeof(fs.valid_max));
+      hasher.update(&fs.precision, sizeof(fs.precision));
+      hasher.update(&fs.display_flags, sizeof(fs.display_flags));
+      break;
+    }
+
+    case UserParamType_Angle:
+      hasher.update(&param.u.ad.dephault, sizeof(param.u.ad.dephault));
+      break;
+
+    case UserParamType_Point2D:
+      hasher.update(&param.u.td.x_dephault, sizeof(param.u.td.x_dephault));
+      hasher.update(&param.u.td.y_dephault, sizeof(param.u.td.y_dephault));
+      break;
+
+    case UserParamType_Color:
+      hasher.update(&param.u.cd.dephault, sizeof(param.u.cd.dephault));
+      break;
+
+    case UserParamType_Image:
+      hasher.update(&param.u.ld.dephault, sizeof(param.u.ld.dephault));
+      break;
+
+    default:
+      break;
+  }
+
+  return hasher.digest();
+}
+
+/**
+ * Sets the label of the param unless the same label and options given as the digest are already applied. The options
+ * modified in params are applied along with the label.
+ */
+static PF_Err applyParamName(AEUtil::EffectStreams& streams,
+                             PF_InData* in_data,
+                             PF_ParamDef* params[],
+                             SequenceData* seqData,
+                             PF_ParamIndex index,
+                             string& label,
+                             uint64_t digest,
+                             ParamsUIStats* stats) {
+  PF_Err err = PF_Err_NONE;
+
+  auto& state = seqData->paramUIStates[index];
+
+  if (state.digest == digest) {
+    stats->numSkipped++;
+    return err;
+  }
+
+  ERR(AEUtil::setParamName(streams, in_data, params, index, label));
+  stats->numApplied++;
+
+  state.digest = err ? 0 : digest;
 
   return err;
 }
@@ -598,29 +992,34 @@ static PF_Err UpdateParamsUI(PF_InData* in_data, PF_OutData* out_data, PF_ParamD
   auto* seqData = reinterpret_cast<SequenceData*>(suites.HandleSuite1()->host_lock_handle(in_data->sequence_data));
 
   auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
-  auto desc = isf->desc;
-  bool isTransition = desc->scene->doc()->type() == VVISF::ISFFileType_Transition;
+  auto desc = requestCompiledSceneDesc(globalData, isf->desc);
+  bool isTransition = desc->doc->type() == VVISF::ISFFileType_Transition;
+
+  // Only the changes from the UI applied last time are applied, since each of them goes through AEGP. The effect and
+  // the streams are acquired once for all of them, and only when any of them is actually accessed.
+  ParamsUIStats stats;
+  AEUtil::EffectStreams streams(globalData->aegpId, in_data);
 
   // Toggle the visibility of ISF options
-  ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, Param_ISF, seqData->showISFOption));
+  ERR(applyParamVisibility(streams, in_data, params, seqData, Param_ISF, seqData->showISFOption, &stats));
 
   // Set the shader status as a label for 'Edit Shader'
   string statusLabel = "ISF: " + desc->status;
-  AEUtil::setParamName(globalData->aegpId, in_data, params, Param_ISF, statusLabel);
+  ERR(applyParamName(streams, in_data, params, seqData, Param_ISF, statusLabel, Hasher().update(statusLabel).digest(), &stats));
 
   // Show the time parameters if the current shader is time dependant
-  bool isTimeDependant = desc->scene->isTimeDependant();
-  ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, Param_UseLayerTime, isTimeDependant));
+  bool isTimeDependant = desc->manifest.isTimeDependant();
+  ERR(applyParamVisibility(streams, in_data, params, seqData, Param_UseLayerTime, isTimeDependant, &stats));
 
   // Toggle the visibility of 'Time' parameter depending on 'Use Layer Time'
   A_Boolean useLayerTime = params[Param_UseLayerTime]->u.bd.value;
-  ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, Param_Time, !useLayerTime && isTimeDependant));
+  ERR(applyParamVisibility(streams, in_data, params, seqData, Param_Time, !useLayerTime && isTimeDependant, &stats));
 
   // Change the visiblity of user params
   PF_ParamIndex userParamIndex = 0;
   UserParamType userParamType;
 
-  auto inputs = desc->scene->inputs();
+  auto inputs = desc->doc->inputs();
 
   for (auto& input : inputs) {
     if (userParamIndex >= inputs.size()) {
@@ -758,43 +1157,52 @@ static PF_Err UpdateParamsUI(PF_InData* in_data, PF_OutData* out_data, PF_ParamD
         break;
     }
 
-    param.uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
+    // Set label
+    auto label = input->label();
+
+    if (label.empty() && isTransition) {
+      // Set a default label for transition-type ISF.
+      auto name = input->name();
+      if (name == "startImage") {
+        label = "Start Image";
+      } else if (name == "endImage") {
+        label = "End Image";
+      } else if (name == "progress") {
+        label = "Progress";
+      }
+    }
 
-    // Set the label and visibility
-    for (int type = 0; type < NumUserParamType; type++) {
-      auto index = getIndexForUserParam(userParamIndex, (UserParamType)type);
-      bool visible = type == userParamType;
-
-      ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, index, visible));
-
-      if (visible) {
-        // Set label
-        auto label = input->label();
-
-        if (label.empty() && isTransition) {
-          // Set a default label for transition-type ISF.
-          auto name = input->name();
-          if (name == "startImage") {
-            label = "Start Image";
-          } else if (name == "endImage") {
-            label = "End Image";
-          } else if (name == "progress") {
-            label = "Progress";
-          }
-        }
+    if (label.empty()) {
+      label = input->name();
+    }
 
-        if (label.empty()) {
-          label = input->name();
-        }
+    if (seqData->showISFOption) {
+      label += " (" + to_string(index) + ")";
+    }
 
-        if (seqData->showISFOption) {
-          label += " (" + to_string(index) + ")";
-        }
+    // Only flag the value as changed when the default or the range has changed
+    auto uiDigest = getParamUIDigest(param, userParamType, label);
 
-        ERR(AEUtil::setParamName(globalData->aegpId, in_data, params, index, label));
-      }
+    if (seqData->paramUIStates[index].digest != uiDigest) {
+      param.uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
     }
 
+    // Set the visibility and the label
+    for (int type = 0; type < NumUserParamType; type++) {
+      ERR(applyParamVisibility(streams, in_data, params, seqData, getIndexForUserParam(userParamIndex, (UserParamType)type), type == userParamType, &stats));
+    }
+
+    ERR(applyParamName(streams, in_data, params, seqData, index, label, uiDigest, &stats));
+
+#if SPECIALIZE_CONSTANT_INPUTS
+    // Find whether the param is constant here, so that SmartPreRender doesn't need to access its stream
+    if (userParamType == UserParamType_Bool || userParamType == UserParamType_Long) {
+      A_Boolean timeVarying = TRUE;
+      PF_Err streamErr = AEUtil::isParamTimeVarying(streams, in_data, index, &timeVarying);
+      seqData->isParamConstant[index] = !streamErr && !timeVarying;
+    }
+#endif
+
     userParamIndex++;
   }
 
@@ -802,10 +1210,12 @@ static PF_Err UpdateParamsUI(PF_InData* in_data, PF_OutData* out_data, PF_ParamD
   for (; userParamIndex < NumUserParams; userParamIndex++) {
     for (int userParamType = 0; userParamType < NumUserParamType; userParamType++) {
       auto index = getIndexForUserParam(userParamIndex, (UserParamType)userParamType);
-      ERR(AEUtil::setParamVisibility(globalData->aegpId, in_data, params, index, false));
+      ERR(applyParamVisibility(streams, in_data, params, seqData, index, false, &stats));
     }
   }
 
+  FX_LOG("UpdateParamsUI: applied=" << stats.numApplied << ", skipped=" << stats.numSkipped << ", AEGP calls=" << streams.numSuiteCalls());
+
   suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
   suites.HandleSuite1()->host_unlock_handle(in_data->sequence_data);
 
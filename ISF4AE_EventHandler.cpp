@@ -5,6 +5,7 @@
 
 #include <codecvt>
 #include <string>
+#include <vector>
 
 #include "AEUtil.h"
 #include "Debug.h"
@@ -148,12 +149,15 @@ static PF_Err DrawCompUIEvent(PF_InData* in_data,
   ERR(suites.DrawbotSuiteCurrent()->GetSurface(drawingRef, &surfaceRef));
 
   auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
-  auto sceneDesc = isf->desc;
+  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+  auto sceneDesc = requestCompiledSceneDesc(globalData, isf->desc);
+  suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
   auto scene = sceneDesc->scene;
 
   // Determine if any Custom Comp UI should be rendered
   bool doRenderErrorLog = !sceneDesc->errorLog.empty();
-  bool doRenderCustomUI = scene->inputNamed("i4a_CustomUI") != nullptr;
+  bool doRenderCustomUI = !sceneDesc->compiled.valid() && scene->inputNamed("i4a_CustomUI") != nullptr;
 
   bool doRenderAny = doRenderErrorLog || doRenderCustomUI;
 
@@ -269,6 +273,10 @@ static PF_Err DrawCompUIEvent(PF_InData* in_data,
       if (doRenderCustomUI) {
         VVGL::Size outSize = {static_cast<double>(clipRect.width), static_cast<double>(clipRect.height)};
 
+        globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+        auto renderContext = globalData->renderContexts->checkout();
+        auto scene = getSceneForRenderContext(*renderContext, sceneDesc->scene);
+
         // Bind special uniforms reserved for ISF4AE
         scene->setValueForInputNamed(VVISF::ISFVal(VVISF::ISFValType_Point2D, zoom, zoom), "i4a_Downsample");
         scene->setValueForInputNamed(VVISF::ISFVal(VVISF::ISFValType_Bool, true), "i4a_CustomUI");
@@ -290,7 +298,27 @@ static PF_Err DrawCompUIEvent(PF_InData* in_data,
         pointScale.width = zoom * (double)in_data->downsample_x.den / in_data->downsample_x.num;
         pointScale.height = zoom * (double)in_data->downsample_y.den / in_data->downsample_y.num;
 
-        ERR(renderISFToCPUBuffer(in_data, out_data, *scene, bitdepth, outSize, pointScale, &overlayImage));
+        ERR(renderISFToCPUBuffer(in_data, out_data, *renderContext, *scene, bitdepth, outSize, pointScale, &overlayImage));
+
+        globalData->renderContexts->checkin(renderContext);
+        suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
+        if (overlayImage && overlayImage->flipped) {
+          // Drawbot only accepts top-to-bottom rows
+          auto bytesPerRow = overlayImage->calculateBackingBytesPerRow();
+          auto* pixels = reinterpret_cast<char*>(overlayImage->cpuBackingPtr);
+          vector<char> row(bytesPerRow);
+
+          for (size_t y = 0; y < outSize.height / 2; y++) {
+            char* top = pixels + y * bytesPerRow;
+            char* bottom = pixels + ((size_t)outSize.height - 1 - y) * bytesPerRow;
+            memcpy(row.data(), top, bytesPerRow);
+            memcpy(top, bottom, bytesPerRow);
+            memcpy(bottom, row.data(), bytesPerRow);
+          }
+
+          overlayImage->flipped = false;
+        }
 
         if (overlayImage) {
           DRAWBOT_ImageRef imageRef = nullptr;
@@ -513,6 +541,95 @@ static PF_Err DoClickEffectControlUIEvent(PF_InData* in_data,
   return err;
 }
 
+/**
+ * Reloads the shader when its files are modified. The current shader is kept until the new one is compiled in
+ * background, and then it's replaced keeping the values of the parameters.
+ */
+static PF_Err ReloadModifiedShader(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_EventExtra* extra, ParamArbIsf* isf) {
+  PF_Err err = PF_Err_NONE;
+
+  AEGP_SuiteHandler suites(in_data->pica_basicP);
+  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+
+  uint64_t version = 0;
+  for (auto& path : getShaderFilePaths(isf->path)) {
+    version += globalData->fileWatcher->getVersion(path);
+  }
+
+  if (version != isf->watchedVersion) {
+    isf->watchedVersion = version;
+
+    // Read the files without holding the global data, which the render threads lock as well
+    suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
+    string fsCode, vsCode;
+    readShaderFiles(isf->path, &fsCode, &vsCode);
+
+    globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+
+    // Ignore the moment the file is truncated before written
+    if (!fsCode.empty()) {
+      isf->pendingDesc = requestCompiledSceneDesc(globalData, getCompiledSceneDesc(globalData, fsCode, vsCode));
+    }
+  }
+
+  if (isf->pendingDesc) {
+    auto desc = resolveSceneDesc(isf->pendingDesc);
+
+    if (!desc->compiled.valid()) {
+      isf->pendingDesc = nullptr;
+
+      if (desc->digest != isf->desc->digest) {
+        FX_LOG("Reloaded the shader: " << isf->path);
+
+        ERR(setSceneDescKeepingValues(in_data, params, desc));
+        out_data->out_flags |= PF_OutFlag_REFRESH_UI;
+        extra->evt_out_flags = PF_EO_HANDLED_EVENT;
+      }
+    }
+  }
+
+  suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
+
+  return err;
+}
+
+/**
+ * Replaces the placeholder of the shader compiled in background with the compiled one. As the value of the parameter
+ * changes, AE renders the effect again and updates the UI with the result of the compilation.
+ */
+static PF_Err IdleEvent(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[], PF_LayerDef* output, PF_EventExtra* extra) {
+  PF_Err err = PF_Err_NONE;
+
+  auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
+
+  if (!isf) {
+    return err;
+  }
+
+#if WATCH_SHADER_FILES
+  if (!isf->path.empty()) {
+    ERR(ReloadModifiedShader(in_data, out_data, params, extra, isf));
+  }
+#endif
+
+  if (!isf->desc->compiled.valid()) {
+    return err;
+  }
+
+  auto desc = resolveSceneDesc(isf->desc);
+
+  if (desc != isf->desc) {
+    isf->desc = desc;
+
+    params[Param_ISF]->uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
+    out_data->out_flags |= PF_OutFlag_REFRESH_UI;
+    extra->evt_out_flags = PF_EO_HANDLED_EVENT;
+  }
+
+  return err;
+}
+
 PF_Err HandleEvent(PF_InData* in_data,
                    PF_OutData* out_data,
                    PF_ParamDef* params[],
@@ -533,6 +650,9 @@ PF_Err HandleEvent(PF_InData* in_data,
     case PF_Event_DO_CLICK:
       DoClickEffectControlUIEvent(in_data, out_data, params, output, extra);
       break;
+    case PF_Event_IDLE:
+      err = IdleEvent(in_data, out_data, params, output, extra);
+      break;
   }
 
   return err;
@@ -88,33 +88,26 @@ bool isISFAttrVisibleInECW(const VVISF::ISFAttrRef input) {
 }
 
 /**
- * Compile a shader and store to pool that maps code string to OGL::Program.
- * It will be called at UpdateParameterUI and PreRender.
+ * Compile a shader and returns the desc with the result. It's called on the compile queue.
  */
-shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string& fsCode, const string& vsCode) {
-  if (fsCode.empty()) {
-    return globalData->notLoadedSceneDesc;
-  }
-
-  string key = fsCode + "__ISF_VERTEX__" + vsCode;
-
-  // Compile a shader at here to make sure to display the latest status
-  auto& scenes = *globalData->scenes;
-
-  if (scenes.has(key)) {
-    // Use cache
-    return scenes.get(key);
-  }
-
-  // Compile new shader if not exists
+static shared_ptr<SceneDesc> compileSceneDesc(GlobalData* globalData,
+                                              const string& fsCode,
+                                              const string& vsCode,
+                                              const Digest128& key,
+                                              const ShaderManifest* manifest) {
   auto scene = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
   scene->setThrowExceptions(true);
   scene->setManualTime(true);
+  scene->setFusesAEConversion(FUSE_AE_CONVERSION);
+  scene->setProgramBinaryCache(globalData->programBinaryCache);
 
   auto desc = make_shared<SceneDesc>();
+  desc->digest = key;
+  desc->fsCode = fsCode;
+  desc->vsCode = vsCode;
 
   try {
-    scene->useCode(fsCode, vsCode);
+    scene->useCode(fsCode, vsCode, manifest);
 
     auto errDict = scene->errDict();
     if (errDict.size() > 0) {
@@ -139,11 +132,15 @@ shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string&
     }
 
     desc->scene = scene;
+    desc->doc = scene->doc();
+    desc->manifest = scene->manifest();
     desc->status = "Compiled Successfully";
 
   } catch (VVISF::ISFErr isfErr) {
     // On Failed, format and save the risen error.
     desc->scene = globalData->defaultScene;
+    desc->doc = globalData->defaultScene->doc();
+    desc->manifest = globalData->defaultScene->manifest();
     desc->status = isfErr.getTypeString();
     desc->errorLog = "";
 
@@ -176,219 +173,488 @@ shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string&
     }
 
   } catch (...) {
-    auto* desc = new SceneDesc();
     desc->scene = globalData->defaultScene;
+    desc->doc = globalData->defaultScene->doc();
+    desc->manifest = globalData->defaultScene->manifest();
     desc->status = "Unknown Error";
     desc->errorLog = "";
   }
 
-  scenes.set(key, desc);
-
   return desc;
 }
 
 /**
- * Open the file dialog and load a shader, then set it to the ISF parameter.
+ * Returns the desc of the shader, which is shared among the effect instances with the same code. A new shader is only
+ * parsed, and a placeholder desc is returned until it's compiled in background by requestCompiledSceneDesc(). So the
+ * shaders of the instances never rendered nor shown, such as the ones on disabled layers, are never compiled. The
+ * requests for the same code share the placeholder, and thus the compilation. The manifest can be given if it's already
+ * known, such as the one saved in the project, to skip analyzing the code.
  */
-PF_Err loadISF(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[]) {
-  PF_Err err = PF_Err_NONE;
+shared_ptr<SceneDesc> getCompiledSceneDesc(GlobalData* globalData, const string& fsCode, const string& vsCode, const ShaderManifest* manifest) {
+  if (fsCode.empty()) {
+    return globalData->notLoadedSceneDesc;
+  }
 
-  AEGP_SuiteHandler suites(in_data->pica_basicP);
+  auto key = getSourceDigest(fsCode, vsCode);
 
-  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+  // Concurrent calls for the same code, such as unflattening the instances of a project, create only one placeholder
+  return globalData->scenes->getOrCreate(key, [globalData, &fsCode, &vsCode, &key, manifest]() {
+    auto desc = make_shared<SceneDesc>();
+    desc->digest = key;
+    desc->status = "Compiling...";
 
-  // Load a shader
-  vector<string> fileTypes = {"fs", "txt", "frag", "glsl"};
+    // Only parse the code so that the inputs are available to the UI right away. The default scene is rendered until
+    // the shader is compiled.
+    desc->scene = globalData->defaultScene;
 
-  // Without this USELESS variable I'm getting a glitch, where the scene
-  // doesn't work without any errors
-  // FIXME: Dig into it to figure it out the reason
-  ISF4AESceneRef useless = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
+    try {
+      desc->doc = VVISF::ISF4AEScene::parseCode(fsCode, vsCode, manifest, &desc->manifest);
+    } catch (...) {
+      // The error will be reported by the compilation
+      desc->doc = globalData->defaultScene->doc();
+      desc->manifest = globalData->defaultScene->manifest();
+    }
 
-  string isfDirectory = "";
-  ERR(AEUtil::getStringPersistentData(in_data, CONFIG_MATCH_NAME, "ISF Directory", DEFAULT_ISF_DIRECTORY, &isfDirectory));
+    desc->fsCode = fsCode;
+    desc->vsCode = vsCode;
+    desc->compilePromise = make_shared<std::promise<shared_ptr<SceneDesc>>>();
+    desc->compiled = desc->compilePromise->get_future().share();
 
-  string srcPath = SystemUtil::openFileDialog(fileTypes, isfDirectory, "Open ISF File");
+    globalData->compileStats->numRegistered++;
 
-  if (!err && !srcPath.empty()) {
-    string fsCode = SystemUtil::readTextFile(srcPath);
+    return desc;
+  });
+}
 
-    isfDirectory = getDirname(srcPath);
-    ERR(AEUtil::setStringPersistentData(in_data, CONFIG_MATCH_NAME, "ISF Directory", isfDirectory));
+/**
+ * Starts compiling the shader of the placeholder unless it's already started, and returns the compiled desc if it has
+ * finished. Call this where the shader is actually needed, such as rendering and showing its status.
+ */
+shared_ptr<SceneDesc> requestCompiledSceneDesc(GlobalData* globalData, const shared_ptr<SceneDesc>& desc) {
+  if (desc->compiled.valid() && !desc->compileRequested.exchange(true)) {
+    auto scenes = globalData->scenes;
+    auto compileStats = globalData->compileStats;
+    auto promise = desc->compilePromise;
+    auto fsCode = desc->fsCode;
+    auto vsCode = desc->vsCode;
+    auto key = desc->digest;
+
+    // Reuse what the placeholder has analyzed, unless it failed to parse
+    shared_ptr<ShaderManifest> manifest;
+    if (desc->doc != globalData->defaultScene->doc()) {
+      manifest = make_shared<ShaderManifest>(desc->manifest);
+    }
 
-    if (!fsCode.empty()) {
-      params[Param_ISF]->uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
+    globalData->compileQueue->post([globalData, scenes, compileStats, promise, fsCode, vsCode, key, manifest]() {
+      auto compiledDesc = compileSceneDesc(globalData, fsCode, vsCode, key, manifest.get());
+      compileStats->numCompiled++;
 
-      auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
+      // Replace the placeholder so that the later requests get the compiled one directly
+      scenes->set(key, compiledDesc);
+      promise->set_value(compiledDesc);
+    });
+  }
 
-      uint32_t userParamIndex = 0;
+  return resolveSceneDesc(desc);
+}
 
-      // Backup old params' values
-      auto oldScene = isf->desc->scene;
-      PF_ParamDefUnion oldParamValues[NumUserParams];
-      for (int i = 0; i < NumUserParams; i++) {
-        AEFX_CLR_STRUCT(oldParamValues[i]);
-      }
-      for (auto& oldInput : oldScene->inputs()) {
-        if (!isISFAttrVisibleInECW(oldInput)) {
-          continue;
-        }
-        UserParamType userParamType = getUserParamTypeForISFAttr(oldInput);
-        PF_ParamIndex index = getIndexForUserParam(userParamIndex, userParamType);
-        oldParamValues[userParamIndex] = params[index]->u;
-        userParamIndex++;
-      }
+/**
+ * Returns the desc of the variant of the compiled shader whose inputs are replaced by the constants. The variant is
+ * compiled in background like other shaders, and the generic one is returned until it's ready, as well as when it fails
+ * to compile or the shader already has too many variants.
+ */
+shared_ptr<SceneDesc> getSpecializedSceneDesc(GlobalData* globalData, const shared_ptr<SceneDesc>& desc, const map<string, string>& constants) {
+  if (constants.empty() || desc->compiled.valid() || desc->scene == globalData->defaultScene) {
+    return desc;
+  }
+
+  auto fsCode = desc->scene->getSpecializedFragCode(constants);
+  auto& vsCode = desc->scene->getVertCode();
 
-      // Load the optional vertex shader (same algorithm with ISFDoc.cpp:80)
-      string noExtPath = VVGL::StringByDeletingExtension(srcPath);
-      string vsCode = "";
+  // The digest of the code also covers the values of the constants
+  auto key = getSourceDigest(fsCode, vsCode);
+
+  {
+    lock_guard<mutex> lock(desc->variantsMutex);
 
-      vsCode = SystemUtil::readTextFile(noExtPath + ".vs");
+    auto& variantDigests = desc->variantDigests;
 
-      if (vsCode.empty()) {
-        vsCode = SystemUtil::readTextFile(noExtPath + ".vert");
+    if (variantDigests.find(key) == variantDigests.end()) {
+      if (variantDigests.size() >= MaxSpecializedVariants) {
+        return desc;
       }
+      variantDigests.insert(key);
+    }
+  }
 
-      isf->name = getBasename(srcPath);
-      isf->desc = getCompiledSceneDesc(globalData, fsCode, vsCode);
+  // The macros of the constants don't change what the code uses
+  auto variant = requestCompiledSceneDesc(globalData, getCompiledSceneDesc(globalData, fsCode, vsCode, &desc->manifest));
 
-      ERR(AEUtil::setEffectName(globalData->aegpId, in_data, isf->name));
+  if (variant->compiled.valid() || variant->scene == globalData->defaultScene) {
+    return desc;
+  }
 
-      // Set default values
-      auto desc = isf->desc;
-      bool isTransition = desc->scene->doc()->type() == VVISF::ISFFileType_Transition;
+  return variant;
+}
 
-      userParamIndex = 0;
+/**
+ * Returns the compiled desc in place of the placeholder if its compilation has finished. Otherwise returns as it is.
+ */
+shared_ptr<SceneDesc> resolveSceneDesc(const shared_ptr<SceneDesc>& desc) {
+  if (desc && desc->compiled.valid() && desc->compiled.wait_for(chrono::seconds(0)) == future_status::ready) {
+    return desc->compiled.get();
+  }
 
-      for (auto& input : desc->scene->inputs()) {
-        if (!isISFAttrVisibleInECW(input)) {
+  return desc;
+}
+
+/**
+ * Tells if the current OpenGL context is rasterized on CPU, by the names of the software renderers of Mesa, Windows,
+ * macOS and SwiftShader.
+ */
+static bool isSoftwareRenderer() {
+  auto* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+  if (!renderer) {
+    return false;
+  }
+
+  string name(renderer);
+
+  for (auto* softwareName : {"llvmpipe", "softpipe", "Software Renderer", "Basic Render Driver", "SwiftShader"}) {
+    if (name.find(softwareName) != string::npos) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Creates a set of GL objects for rendering a frame. It's called lazily by the pool of render contexts when all of the
+ * existing ones are in use.
+ */
+shared_ptr<RenderContext> createRenderContext(const VVGL::GLContextRef& sharedContext,
+                                              const string& ae2glCode,
+                                              const string& gl2aeCode,
+                                              ThreadPool* threadPool) {
+  auto renderContext = make_shared<RenderContext>();
+
+  renderContext->threadPool = threadPool;
+
+  renderContext->context = sharedContext->newContextSharingMe();
+  renderContext->uploader = VVGL::CreateGLCPUToTexCopierRefUsing(sharedContext->newContextSharingMe());
+  renderContext->downloader = VVGL::CreateGLTexToCPUCopierRefUsing(sharedContext->newContextSharingMe());
+
+  renderContext->ae2glScene = VVISF::CreateISF4AESceneRefUsing(sharedContext->newContextSharingMe());
+  renderContext->ae2glScene->useCode(ae2glCode, "");
+
+  renderContext->gl2aeScene = VVISF::CreateISF4AESceneRefUsing(sharedContext->newContextSharingMe());
+  renderContext->gl2aeScene->useCode(gl2aeCode, "");
+
+  renderContext->context->makeCurrentIfNotCurrent();
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &renderContext->maxTextureSize);
+  renderContext->isSoftwareRenderer = isSoftwareRenderer();
+
+  return renderContext;
+}
+
+RenderContext::~RenderContext() {
+  context->makeCurrentIfNotCurrent();
+
+  for (auto& readback : readbackBuffers) {
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+    if (readback.fence) {
+      glDeleteSync(readback.fence);
+    }
+#endif
+    if (readback.pbo) {
+      glDeleteBuffers(1, &readback.pbo);
+    }
+  }
+
+  if (readFramebuffer) {
+    glDeleteFramebuffers(1, &readFramebuffer);
+  }
+}
+
+/**
+ * Returns true when the pixels for the scene are converted by the CPU kernels instead of the ae2gl and gl2ae passes.
+ */
+bool convertsAEFormatOnCPU(const RenderContext& renderContext, const ISF4AEScene& scene) {
+  return CPU_AE_CONVERSION && renderContext.isSoftwareRenderer && !scene.fusesAEConversion();
+}
+
+/**
+ * Returns a clone of the scene which is exclusively used by the render context, so that the input values and pass
+ * buffers won't be overwritten by other threads rendering the same shader.
+ */
+VVISF::ISF4AESceneRef getSceneForRenderContext(RenderContext& renderContext, const VVISF::ISF4AESceneRef& scene) {
+  auto& scenes = renderContext.scenes;
+
+  // Dispose the clones of scenes that are no longer used
+  for (auto it = scenes.begin(); it != scenes.end();) {
+    if (it->second.first.expired()) {
+      it = scenes.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  auto it = scenes.find(scene.get());
+
+  if (it != scenes.end()) {
+    return it->second.second;
+  }
+
+  auto clone = scene->cloneUsing(renderContext.context->newContextSharingMe());
+
+  scenes[scene.get()] = make_pair(weak_ptr<VVISF::ISF4AEScene>(scene), clone);
+
+  return clone;
+}
+
+/**
+ * Replaces the shader of the parameter, keeping the values of the inputs with the same names and types as the old shader
+ * and setting the default values to the others.
+ */
+PF_Err setSceneDescKeepingValues(PF_InData* in_data, PF_ParamDef* params[], const shared_ptr<SceneDesc>& desc) {
+  PF_Err err = PF_Err_NONE;
+
+  params[Param_ISF]->uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
+
+  auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
+
+  uint32_t userParamIndex = 0;
+
+  // Backup old params' values
+  auto oldDoc = isf->desc->doc;
+  PF_ParamDefUnion oldParamValues[NumUserParams];
+  for (int i = 0; i < NumUserParams; i++) {
+    AEFX_CLR_STRUCT(oldParamValues[i]);
+  }
+  for (auto& oldInput : oldDoc->inputs()) {
+    if (!isISFAttrVisibleInECW(oldInput)) {
+      continue;
+    }
+    UserParamType userParamType = getUserParamTypeForISFAttr(oldInput);
+    PF_ParamIndex index = getIndexForUserParam(userParamIndex, userParamType);
+    oldParamValues[userParamIndex] = params[index]->u;
+    userParamIndex++;
+  }
+
+  isf->desc = desc;
+
+  // Set default values
+  bool isTransition = desc->doc->type() == VVISF::ISFFileType_Transition;
+
+  userParamIndex = 0;
+
+  for (auto& input : desc->doc->inputs()) {
+    if (!isISFAttrVisibleInECW(input)) {
+      continue;
+    }
+
+    auto userParamType = getUserParamTypeForISFAttr(input);
+    auto index = getIndexForUserParam(userParamIndex, userParamType);
+    auto& param = *params[index];
+
+    auto oldInput = oldDoc->input(input->name());
+    PF_ParamDefUnion* oldValue = nullptr;
+    if (oldInput && oldInput->type() == input->type()) {
+      // When the old scene has an input with same name and type
+      auto idx = 0;
+      for (auto& oi : oldDoc->inputs()) {
+        if (!isISFAttrVisibleInECW(oi)) {
           continue;
         }
+        if (oldInput == oi) {
+          oldValue = &oldParamValues[idx];
+          break;
+        }
 
-        auto userParamType = getUserParamTypeForISFAttr(input);
-        auto index = getIndexForUserParam(userParamIndex, userParamType);
-        auto& param = *params[index];
-
-        auto oldInput = oldScene->inputNamed(input->name());
-        PF_ParamDefUnion* oldValue = nullptr;
-        if (oldInput && oldInput->type() == input->type()) {
-          // When the old scene has an input with same name and type
-          auto idx = 0;
-          for (auto& oi : oldScene->inputs()) {
-            if (!isISFAttrVisibleInECW(oi)) {
-              continue;
-            }
-            if (oldInput == oi) {
-              oldValue = &oldParamValues[idx];
-              break;
-            }
-
-            idx++;
-          }
+        idx++;
+      }
+    }
+
+    param.uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
+
+    switch (userParamType) {
+      case UserParamType_Bool:
+        if (oldValue) {
+          param.u.bd.value = oldValue->bd.value;
+        } else {
+          param.u.bd.value = input->defaultVal().getBoolVal();
         }
+        break;
 
-        param.uu.change_flags |= PF_ChangeFlag_CHANGED_VALUE;
-
-        switch (userParamType) {
-          case UserParamType_Bool:
-            if (oldValue) {
-              param.u.bd.value = oldValue->bd.value;
-            } else {
-              param.u.bd.value = input->defaultVal().getBoolVal();
-            }
-            break;
-
-          case UserParamType_Long: {
-            A_long dephault = 1;
-            auto values = input->valArray();
-            if (oldValue) {
-              dephault = oldValue->pd.value;
-            } else {
-              auto dephaultIsfVal = input->defaultVal().getLongVal();
-              dephault = mmax(1, findIndex(values, dephaultIsfVal) + 1);
-            }
-            param.u.pd.value = dephault;
-            break;
-          }
+      case UserParamType_Long: {
+        A_long dephault = 1;
+        auto values = input->valArray();
+        if (oldValue) {
+          dephault = oldValue->pd.value;
+        } else {
+          auto dephaultIsfVal = input->defaultVal().getLongVal();
+          dephault = mmax(1, findIndex(values, dephaultIsfVal) + 1);
+        }
+        param.u.pd.value = dephault;
+        break;
+      }
+
+      case UserParamType_Float: {
+        double dephault = 0.0;
 
-          case UserParamType_Float: {
-            double dephault = 0.0;
-
-            if (oldValue) {
-              dephault = oldValue->fs_d.value;
-            } else {
-              if (input->type() == VVISF::ISFValType_Float) {
-                dephault = input->defaultVal().getDoubleVal();
-              } else {
-                // input->type() == VVISF::ISFValType_Long
-                dephault = input->defaultVal().getLongVal();
-              }
-
-              auto unit = input->unit();
-
-              if (unit == VVISF::ISFValUnit_Length) {
-                dephault *= in_data->width;
-              } else if (unit == VVISF::ISFValUnit_Percent) {
-                dephault *= 100;
-              }
-
-              if (isTransition && input->name() == "progress") {
-                dephault = 0;
-              }
-            }
-
-            param.u.fs_d.value = dephault;
-            break;
+        if (oldValue) {
+          dephault = oldValue->fs_d.value;
+        } else {
+          if (input->type() == VVISF::ISFValType_Float) {
+            dephault = input->defaultVal().getDoubleVal();
+          } else {
+            // input->type() == VVISF::ISFValType_Long
+            dephault = input->defaultVal().getLongVal();
           }
 
-          case UserParamType_Angle:
-            if (oldValue) {
-              param.u.ad.value = oldValue->ad.value;
-            } else {
-              param.u.ad.value = getDefaultForAngleInput(input);
-            }
-            break;
-
-          case UserParamType_Point2D: {
-            if (oldValue) {
-              param.u.td.x_value = oldValue->td.x_value;
-              param.u.td.y_value = oldValue->td.y_value;
-            } else {
-              auto x = input->defaultVal().getPointValByIndex(0);
-              auto y = input->defaultVal().getPointValByIndex(1);
-
-              param.u.td.x_value = FLOAT2FIX(x * in_data->width);
-              param.u.td.y_value = FLOAT2FIX((1.0 - y) * in_data->height);
-            }
-            break;
+          auto unit = input->unit();
+
+          if (unit == VVISF::ISFValUnit_Length) {
+            dephault *= in_data->width;
+          } else if (unit == VVISF::ISFValUnit_Percent) {
+            dephault *= 100;
           }
 
-          case UserParamType_Color: {
-            if (oldValue) {
-              param.u.cd.value = oldValue->cd.value;
-            } else {
-              auto dephault = input->defaultVal();
-
-              param.u.cd.value.red = dephault.getColorValByChannel(0) * 255;
-              param.u.cd.value.green = dephault.getColorValByChannel(1) * 255;
-              param.u.cd.value.blue = dephault.getColorValByChannel(2) * 255;
-              param.u.cd.value.alpha = dephault.getColorValByChannel(3) * 255;
-            }
-            break;
+          if (isTransition && input->name() == "progress") {
+            dephault = 0;
           }
+        }
+
+        param.u.fs_d.value = dephault;
+        break;
+      }
 
-          case UserParamType_Image:
-            if (oldValue) {
-              param.u.ld = oldValue->ld;
-            }
-            break;
+      case UserParamType_Angle:
+        if (oldValue) {
+          param.u.ad.value = oldValue->ad.value;
+        } else {
+          param.u.ad.value = getDefaultForAngleInput(input);
+        }
+        break;
+
+      case UserParamType_Point2D: {
+        if (oldValue) {
+          param.u.td.x_value = oldValue->td.x_value;
+          param.u.td.y_value = oldValue->td.y_value;
+        } else {
+          auto x = input->defaultVal().getPointValByIndex(0);
+          auto y = input->defaultVal().getPointValByIndex(1);
 
-          default:
-            break;
+          param.u.td.x_value = FLOAT2FIX(x * in_data->width);
+          param.u.td.y_value = FLOAT2FIX((1.0 - y) * in_data->height);
         }
+        break;
+      }
+
+      case UserParamType_Color: {
+        if (oldValue) {
+          param.u.cd.value = oldValue->cd.value;
+        } else {
+          auto dephault = input->defaultVal();
+
+          param.u.cd.value.red = dephault.getColorValByChannel(0) * 255;
+          param.u.cd.value.green = dephault.getColorValByChannel(1) * 255;
+          param.u.cd.value.blue = dephault.getColorValByChannel(2) * 255;
+          param.u.cd.value.alpha = dephault.getColorValByChannel(3) * 255;
+        }
+        break;
+      }
+
+      case UserParamType_Image:
+        if (oldValue) {
+          param.u.ld = oldValue->ld;
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    userParamIndex++;
+  }  // End of for-each ISF's inputs
+
+  return err;
+}
+
+/**
+ * Reads the fragment shader and the optional vertex shader next to it (same algorithm with ISFDoc.cpp:80).
+ */
+void readShaderFiles(const string& srcPath, string* fsCode, string* vsCode) {
+  *fsCode = SystemUtil::readTextFile(srcPath);
+
+  string noExtPath = VVGL::StringByDeletingExtension(srcPath);
+
+  *vsCode = SystemUtil::readTextFile(noExtPath + ".vs");
+
+  if (vsCode->empty()) {
+    *vsCode = SystemUtil::readTextFile(noExtPath + ".vert");
+  }
+}
+
+/**
+ * Returns the paths of the files that readShaderFiles() reads, including the vertex shaders that don't exist yet.
+ */
+vector<string> getShaderFilePaths(const string& srcPath) {
+  string noExtPath = VVGL::StringByDeletingExtension(srcPath);
 
-        userParamIndex++;
-      }  // End of for-each ISF's inputs
+  return {srcPath, noExtPath + ".vs", noExtPath + ".vert"};
+}
+
+/**
+ * Open the file dialog and load a shader, then set it to the ISF parameter.
+ */
+PF_Err loadISF(PF_InData* in_data, PF_OutData* out_data, PF_ParamDef* params[]) {
+  PF_Err err = PF_Err_NONE;
+
+  AEGP_SuiteHandler suites(in_data->pica_basicP);
+
+  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+
+  // Load a shader
+  vector<string> fileTypes = {"fs", "txt", "frag", "glsl"};
+
+  // Without this USELESS variable I'm getting a glitch, where the scene
+  // doesn't work without any errors
+  // FIXME: Dig into it to figure it out the reason
+  ISF4AESceneRef useless = VVISF::CreateISF4AESceneRefUsing(globalData->context->newContextSharingMe());
+
+  string isfDirectory = "";
+  ERR(AEUtil::getStringPersistentData(in_data, CONFIG_MATCH_NAME, "ISF Directory", DEFAULT_ISF_DIRECTORY, &isfDirectory));
+
+  string srcPath = SystemUtil::openFileDialog(fileTypes, isfDirectory, "Open ISF File");
+
+  if (!err && !srcPath.empty()) {
+    string fsCode, vsCode;
+    readShaderFiles(srcPath, &fsCode, &vsCode);
+
+    isfDirectory = getDirname(srcPath);
+    ERR(AEUtil::setStringPersistentData(in_data, CONFIG_MATCH_NAME, "ISF Directory", isfDirectory));
+
+    if (!fsCode.empty()) {
+      auto* isf = reinterpret_cast<ParamArbIsf*>(*params[Param_ISF]->u.arb_d.value);
+
+      isf->name = getBasename(srcPath);
+      isf->path = srcPath;
+      isf->pendingDesc = nullptr;
+
+#if WATCH_SHADER_FILES
+      isf->watchedVersion = 0;
+      for (auto& path : getShaderFilePaths(srcPath)) {
+        isf->watchedVersion += globalData->fileWatcher->watch(path);
+      }
+#endif
+
+      ERR(setSceneDescKeepingValues(in_data, params, getCompiledSceneDesc(globalData, fsCode, vsCode)));
+
+      AEUtil::EffectStreams streams(globalData->aegpId, in_data);
+      ERR(AEUtil::setEffectName(streams, in_data, isf->name));
 
     } else {
       // On failed reading the text file, or simply it's empty
@@ -426,11 +692,13 @@ PF_Err saveISF(PF_InData* in_data, PF_OutData* out_data) {
   string dstPath = SystemUtil::saveFileDialog(effectName + ".fs", isfDirectory, "Save ISF File");
 
   if (!err && !dstPath.empty()) {
-    string fsCode = isf->desc->scene->getFragCode();
+    // Save the default shader when no shader is loaded
+    bool isLoaded = !isf->desc->fsCode.empty();
+    string fsCode = isLoaded ? isf->desc->fsCode : isf->desc->scene->getFragCode();
 
     SystemUtil::writeTextFile(dstPath, fsCode);
 
-    auto& vsCode = *isf->desc->scene->doc()->vertShaderSource();
+    auto& vsCode = isLoaded ? isf->desc->vsCode : *isf->desc->doc->vertShaderSource();
     if (!vsCode.empty()) {
       auto noExtPath = VVGL::StringByDeletingExtension(dstPath);
       SystemUtil::writeTextFile(noExtPath + ".vs", vsCode);
@@ -481,21 +749,90 @@ VVGL::GLBufferRef createRGBACPUBufferWithBitdepthUsing(const VVGL::Size& inCPUBu
   }
 }
 
-PF_Err uploadCPUBufferInSmartRender(GlobalData* globalData,
-                                    PF_ProgPtr effectRef,
-                                    PF_SmartRenderExtra* extra,
-                                    A_long checkoutIndex,
+static GLenum getGLPixelTypeForBitdepth(short bitdepth) {
+  switch (bitdepth) {
+    case 8:
+      return GL_UNSIGNED_BYTE;
+    case 16:
+      return GL_UNSIGNED_SHORT;
+    case 32:
+      return GL_FLOAT;
+    default:
+      throw invalid_argument("Invalid bitdepth");
+  }
+}
+
+/**
+ * Makes the texture holding ARGB pixels be sampled as RGBA, or restores the default swizzle. Since textures are recycled
+ * by the buffer pool, the swizzle must be restored once the texture is no longer used as an input.
+ */
+void setTextureSwizzleFromAE(const VVGL::GLBufferRef& texture, bool fromAE) {
+#ifdef GL_TEXTURE_SWIZZLE_RGBA
+  GLint argb[] = {GL_GREEN, GL_BLUE, GL_ALPHA, GL_RED};
+  GLint rgba[] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+
+  glBindTexture(GL_TEXTURE_2D, texture->name);
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, fromAE ? argb : rgba);
+  glBindTexture(GL_TEXTURE_2D, 0);
+#endif
+}
+
+/**
+ * Uploads the pixels of the layer to a texture of the same size, reading the rows in place by the unpack row length
+ * instead of wrapping them by a CPU buffer. When convertsOnCPU is true, the pixels are converted to OpenGL's format by
+ * the CPU kernels beforehand. As the rows are stored from top to bottom, the texture is marked as flipped.
+ * Returns nullptr when the pitch of the layer is not representable.
+ */
+static VVGL::GLBufferRef uploadLayerToTex(RenderContext& renderContext, PF_LayerDef* layerDef, short bitdepth, bool convertsOnCPU) {
+  A_long pixelBytes = bitdepth * 4 / 8;
+  const void* pixels = layerDef->data;
+  A_long rowLength = layerDef->rowbytes / pixelBytes;
+
+  if (convertsOnCPU) {
+    size_t bytesPerRow = (size_t)layerDef->width * pixelBytes;
+    renderContext.conversionBuffer.resize(bytesPerRow * layerDef->height);
+
+    PixelConvert::convert(PixelConvert::AEToGL, layerDef->data, layerDef->rowbytes, renderContext.conversionBuffer.data(), bytesPerRow, layerDef->width,
+                          layerDef->height, bitdepth, false, renderContext.threadPool);
+
+    pixels = renderContext.conversionBuffer.data();
+    rowLength = layerDef->width;
+
+  } else if (layerDef->rowbytes <= 0 || layerDef->rowbytes % pixelBytes != 0) {
+    return nullptr;
+  }
+
+  VVGL::Size size(layerDef->width, layerDef->height);
+  auto texture = createRGBATexWithBitdepth(size, renderContext.context, bitdepth);
+
+  glBindTexture(GL_TEXTURE_2D, texture->name);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, layerDef->width, layerDef->height, GL_RGBA, getGLPixelTypeForBitdepth(bitdepth), pixels);
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  texture->flipped = true;
+
+  return texture;
+}
+
+/**
+ * Uploads the pixels of the layer checked out in SmartRender as a texture of the output size.
+ */
+PF_Err uploadCPUBufferInSmartRender(RenderContext& renderContext,
+                                    PF_LayerDef* layerDef,
+                                    short bitdepth,
                                     const VVGL::Size outImageSize,
+                                    bool keepsAELayout,
                                     VVGL::GLBufferRef& outImage) {
-  PF_Err err = PF_Err_NONE, err2 = PF_Err_NONE;
+  PF_Err err = PF_Err_NONE;
 
-  auto bitdepth = extra->input->bitdepth;
   auto pixelBytes = bitdepth * 4 / 8;
 
-  PF_LayerDef* layerDef = nullptr;
-
-  ERR(extra->cb->checkout_layer_pixels(effectRef, checkoutIndex, &layerDef));
-
   if (layerDef != nullptr) {
     // Stores the actual buffer size of images which has just done checkout-- affected by downsamples and cropping.
     VVGL::Size imageSize(layerDef->width, layerDef->height);
@@ -509,202 +846,674 @@ PF_Err uploadCPUBufferInSmartRender(GlobalData* globalData,
       return err;
     }
 
-    VVGL::GLBufferRef imageAECPU = createRGBACPUBufferWithBitdepthUsing(bufferSizeInPixel, layerDef->data, imageSize, bitdepth);
+    bool convertsOnCPU = !keepsAELayout && CPU_AE_CONVERSION && renderContext.isSoftwareRenderer;
+
+#ifdef GL_TEXTURE_SWIZZLE_RGBA
+    // Swizzling can't scale the 16-bit range, so it needs the ae2gl pass
+    bool swizzles = !keepsAELayout && !convertsOnCPU && bitdepth != 16;
+#else
+    bool swizzles = false;
+#endif
+
+    VVGL::GLBufferRef imageAE = nullptr;
+
+    if (keepsAELayout || swizzles || convertsOnCPU) {
+      imageAE = uploadLayerToTex(renderContext, layerDef, bitdepth, convertsOnCPU);
+
+      if (!imageAE && keepsAELayout) {
+        VVGL::GLBufferRef imageAECPU = createRGBACPUBufferWithBitdepthUsing(bufferSizeInPixel, layerDef->data, imageSize, bitdepth);
+        imageAE = renderContext.uploader->uploadCPUToTex(imageAECPU);
+      }
+    }
+
+    if (imageAE) {
+      // Let the scene sample the uploaded texture directly. The origin offset and the vertical flip are applied through
+      // the source rect, which is relative to the texture in pixels, and the channels are reordered by the swizzle
+      // unless they're already converted on CPU or the scene converts them by itself.
+      bool coversOutput = layerDef->origin_x == 0 && layerDef->origin_y == 0 && imageSize.width == outImageSize.width &&
+                          imageSize.height == outImageSize.height;
+      GLint wrap = coversOutput ? GL_CLAMP_TO_EDGE : GL_CLAMP_TO_BORDER;
+
+      glBindTexture(GL_TEXTURE_2D, imageAE->name);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      if (swizzles) {
+        setTextureSwizzleFromAE(imageAE, true);
+      }
 
-    auto imageAE = globalData->uploader->uploadCPUToTex(imageAECPU);
+      imageAE->srcRect = VVGL::Rect(-layerDef->origin_x, -layerDef->origin_y, outImageSize.width, outImageSize.height);
+      imageAE->flipped = true;
 
-    // Note that AE's inputImage is cropped by mask's region and smaller than ISF resolution.
-    glBindTexture(GL_TEXTURE_2D, imageAE->name);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glBindTexture(GL_TEXTURE_2D, 0);
+      outImage = imageAE;
 
-    auto origin = VVISF::ISFVal(VVISF::ISFValType_Point2D, layerDef->origin_x, layerDef->origin_y);
+    } else {
+      VVGL::GLBufferRef imageAECPU = createRGBACPUBufferWithBitdepthUsing(bufferSizeInPixel, layerDef->data, imageSize, bitdepth);
 
-    globalData->ae2glScene->setBufferForInputNamed(imageAE, "inputImage");
-    globalData->ae2glScene->setValueForInputNamed(origin, "origin");
+      imageAE = renderContext.uploader->uploadCPUToTex(imageAECPU);
 
-    outImage = createRGBATexWithBitdepth(outImageSize, globalData->context, bitdepth);
+      // Note that AE's inputImage is cropped by mask's region and smaller than ISF resolution.
+      glBindTexture(GL_TEXTURE_2D, imageAE->name);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+      glBindTexture(GL_TEXTURE_2D, 0);
 
-    globalData->ae2glScene->renderToBuffer(outImage);
+      auto origin = VVISF::ISFVal(VVISF::ISFValType_Point2D, layerDef->origin_x, layerDef->origin_y);
 
-    // Though ISF specs does not specify the wrap mode of texture, set it to CLAMP_TO_EDGE to match with online ISF
-    // editor's behavior.
-    glBindTexture(GL_TEXTURE_2D, outImage->name);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-  }
+      renderContext.ae2glScene->setBufferForInputNamed(imageAE, "inputImage");
+      renderContext.ae2glScene->setValueForInputNamed(origin, "origin");
+
+      outImage = createRGBATexWithBitdepth(outImageSize, renderContext.context, bitdepth);
 
-  ERR2(extra->cb->checkin_layer_pixels(effectRef, checkoutIndex));
+      renderContext.ae2glScene->renderToBuffer(outImage);
+
+      // Though ISF specs does not specify the wrap mode of texture, set it to CLAMP_TO_EDGE to match with online ISF
+      // editor's behavior.
+      glBindTexture(GL_TEXTURE_2D, outImage->name);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+  }
 
   return err;
 }
 
 /**
- * Renders ISF scene to CPU buffer. It's used at SmartRender() and DrawEvent(), and assuming image inputs are already
- * bounded by the callees.
+ * Feeds the current values of the non-image inputs of the scene to the hasher.
  */
-PF_Err
-renderISFToCPUBuffer(PF_InData* in_data, PF_OutData* out_data, ISF4AEScene& scene, short bitdepth, VVGL::Size& outSize, VVGL::Size& pointScale, VVGL::GLBufferRef* outBuffer) {
+void hashISFInputValues(Hasher& hasher, ISF4AEScene& scene) {
+  for (auto& input : scene.inputs()) {
+    auto type = input->type();
+
+    if (type == VVISF::ISFValType_Image) {
+      continue;
+    }
+
+    auto val = input->currentVal();
+
+    hasher.update(input->name());
+    hasher.add(type);
+
+    switch (type) {
+      case VVISF::ISFValType_Bool:
+        hasher.add(val.getBoolVal());
+        break;
+      case VVISF::ISFValType_Long:
+        hasher.add(val.getLongVal());
+        break;
+      case VVISF::ISFValType_Point2D:
+        hasher.add(val.getPointValByIndex(0));
+        hasher.add(val.getPointValByIndex(1));
+        break;
+      case VVISF::ISFValType_Color:
+        for (int c = 0; c < 4; c++) {
+          hasher.add(val.getColorValByChannel(c));
+        }
+        break;
+      default:
+        hasher.add(val.getDoubleVal());
+        break;
+    }
+  }
+}
+
+static int32_t getLongInputValue(const VVISF::ISFAttrRef& input, A_long popupIndex) {
+  auto v = popupIndex - 1;  // Index of popup UI begins from 1
+  if (input->valArray().size() > v) {
+    return input->valArray()[popupIndex - 1];
+  } else {
+    return v + input->minVal().getLongVal();  // ISFEditor behaviour
+  }
+}
+
+/**
+ * Collects the values of the bool and long inputs that are neither keyframed nor driven by an expression, formatted as
+ * GLSL literals and keyed by the names of the inputs. Which params are constant is cached in the sequence data by
+ * UpdateParamsUI. Leaves the constants empty if any of them can't be read, since the generic shader can render the frame
+ * anyway.
+ */
+void getConstantInputValues(PF_InData* in_data, PF_OutData* out_data, const SequenceData& seqData, ISF4AEScene& scene, map<string, string>* constants) {
   PF_Err err = PF_Err_NONE;
 
-  AEGP_SuiteHandler suites(in_data->pica_basicP);
+  PF_ParamIndex userParamIndex = 0;
 
-  auto* globalData = reinterpret_cast<GlobalData*>(suites.HandleSuite1()->host_lock_handle(in_data->global_data));
+  for (auto input : scene.inputs()) {
+    if (!isISFAttrVisibleInECW(input)) {
+      continue;
+    }
 
-  // In After Effects, 16-bit pixel doesn't use the highest bit, and thus each channel ranges 0x0000 - 0x8000.
-  // So after passing pixel buffer to GPU, it should be scaled by (0xffff / 0x8000) to normalize the luminance to
-  // 0.0-1.0.
-  VVISF::ISFVal multiplier16bit(VVISF::ISFValType_Float, bitdepth == 16 ? (65535.0f / 32768.0f) : 1.0f);
-  globalData->ae2glScene->setValueForInputNamed(multiplier16bit, "multiplier16bit");
-  globalData->gl2aeScene->setValueForInputNamed(multiplier16bit, "multiplier16bit");
+    auto userParamType = getUserParamTypeForISFAttr(input);
+    auto paramIndex = getIndexForUserParam(userParamIndex, userParamType);
+    userParamIndex++;
 
-  // Render ISF
-  auto isfImage = createRGBATexWithBitdepth(outSize, globalData->context, bitdepth);
-  {
-    // Assign time-related variables
-    double fps = in_data->time_scale / in_data->local_time_step;
-    double time = 0;
+    if (userParamType != UserParamType_Bool && userParamType != UserParamType_Long) {
+      continue;
+    }
 
-    PF_Boolean useLayerTime = false;
-    ERR(AEUtil::getCheckboxParam(in_data, out_data, Param_UseLayerTime, &useLayerTime));
+    if (!seqData.isParamConstant[paramIndex]) {
+      continue;
+    }
 
-    if (useLayerTime) {
-      time = (double)in_data->current_time / in_data->time_scale;
+    if (userParamType == UserParamType_Bool) {
+      PF_Boolean v = false;
+      ERR(AEUtil::getCheckboxParam(in_data, out_data, paramIndex, &v));
+      (*constants)[input->name()] = v ? "true" : "false";
     } else {
-      ERR(AEUtil::getFloatSliderParam(in_data, out_data, Param_Time, &time));
+      A_long index = 0;
+      ERR(AEUtil::getPopupParam(in_data, out_data, paramIndex, &index));
+      (*constants)[input->name()] = to_string(getLongInputValue(input, index));
     }
 
-    scene.setRenderFrameIndex(time * fps);
-    scene.setRenderTimeDelta(1.0 / fps);
+    if (err) {
+      break;
+    }
+  }
 
-    // Assign user-defined parameters
-    PF_ParamIndex userParamIndex = 0;
+  if (err) {
+    constants->clear();
+  }
+}
 
-    for (auto input : scene.inputs()) {
-      if (!isISFAttrVisibleInECW(input)) {
-        continue;
-      }
+/**
+ * Assigns the time and the values of user parameters to the ISF scene, except for image inputs, which have to be bound
+ * by the callees beforehand. The time is returned so that it can be passed to renderISFToTexture().
+ */
+PF_Err setISFInputValues(PF_InData* in_data, PF_OutData* out_data, ISF4AEScene& scene, VVGL::Size& outSize, VVGL::Size& pointScale, double* outTime) {
+  PF_Err err = PF_Err_NONE;
 
-      auto isfType = input->type();
-      auto userParamType = getUserParamTypeForISFAttr(input);
-      auto paramIndex = getIndexForUserParam(userParamIndex, userParamType);
+  // Assign time-related variables
+  double fps = in_data->time_scale / in_data->local_time_step;
+  double& time = *outTime;
 
-      VVISF::ISFVal* val = nullptr;
+  PF_Boolean useLayerTime = false;
+  ERR(AEUtil::getCheckboxParam(in_data, out_data, Param_UseLayerTime, &useLayerTime));
 
-      switch (userParamType) {
-        case UserParamType_Bool: {
-          PF_Boolean v = false;
-          ERR(AEUtil::getCheckboxParam(in_data, out_data, paramIndex, &v));
-          val = new VVISF::ISFVal(isfType, v);
-          break;
-        }
-        case UserParamType_Long: {
-          A_long index = 0;
-          ERR(AEUtil::getPopupParam(in_data, out_data, paramIndex, &index));
-          auto v = index - 1;  // Index of popup UI begins from 1
-          if (input->valArray().size() > v) {
-            v = input->valArray()[index - 1];
-          } else {
-            v = v + input->minVal().getLongVal();  // ISFEditor behaviour
-          }
-          val = new VVISF::ISFVal(isfType, v);
-          break;
-        }
-        case UserParamType_Float: {
-          if (input->type() == VVISF::ISFValType_Float) {
-            A_FpLong v = 0.0;
-            ERR(AEUtil::getFloatSliderParam(in_data, out_data, paramIndex, &v));
+  if (useLayerTime) {
+    time = (double)in_data->current_time / in_data->time_scale;
+  } else {
+    ERR(AEUtil::getFloatSliderParam(in_data, out_data, Param_Time, &time));
+  }
 
-            VVISF::ISFValUnit unit = input->unit();
+  scene.setRenderFrameIndex(time * fps);
+  scene.setRenderTimeDelta(1.0 / fps);
 
-            if (scene.doc()->type() == VVISF::ISFFileType_Transition && input->name() == "progress") {
-              unit = VVISF::ISFValUnit_Percent;
-            }
+  // Assign user-defined parameters
+  PF_ParamIndex userParamIndex = 0;
 
-            if (unit == VVISF::ISFValUnit_Length) {
-              v /= in_data->width;
-            } else if (unit == VVISF::ISFValUnit_Percent) {
-              v /= 100;
-            }
+  for (auto input : scene.inputs()) {
+    if (!isISFAttrVisibleInECW(input)) {
+      continue;
+    }
 
-            val = new VVISF::ISFVal(isfType, v);
-          } else {
-            // input->type() == VVISF::ISFValType_Long
+    auto isfType = input->type();
+    auto userParamType = getUserParamTypeForISFAttr(input);
+    auto paramIndex = getIndexForUserParam(userParamIndex, userParamType);
 
-            A_FpLong floatIndex = 0.0;
-            ERR(AEUtil::getFloatSliderParam(in_data, out_data, paramIndex, &floatIndex));
+    VVISF::ISFVal* val = nullptr;
 
-            A_long index = (A_long)floatIndex;
+    switch (userParamType) {
+      case UserParamType_Bool: {
+        PF_Boolean v = false;
+        ERR(AEUtil::getCheckboxParam(in_data, out_data, paramIndex, &v));
+        val = new VVISF::ISFVal(isfType, v);
+        break;
+      }
+      case UserParamType_Long: {
+        A_long index = 0;
+        ERR(AEUtil::getPopupParam(in_data, out_data, paramIndex, &index));
+        val = new VVISF::ISFVal(isfType, getLongInputValue(input, index));
+        break;
+      }
+      case UserParamType_Float: {
+        if (input->type() == VVISF::ISFValType_Float) {
+          A_FpLong v = 0.0;
+          ERR(AEUtil::getFloatSliderParam(in_data, out_data, paramIndex, &v));
 
-            val = new VVISF::ISFVal(isfType, index);
+          VVISF::ISFValUnit unit = input->unit();
+
+          if (scene.doc()->type() == VVISF::ISFFileType_Transition && input->name() == "progress") {
+            unit = VVISF::ISFValUnit_Percent;
           }
-          break;
-        }
-        case UserParamType_Angle: {
-          A_FpLong v = 0.0;
-          AEUtil::getAngleParam(in_data, out_data, paramIndex, &v);
-          if (input->unit() == VVISF::ISFValUnit_Direction) {
-            v = (-v + 90.0) * (PI / 180.0);
-          } else {  // unit == VVISF::ISFValUnit_Angle
-            v = -v * (PI / 180.0);
+
+          if (unit == VVISF::ISFValUnit_Length) {
+            v /= in_data->width;
+          } else if (unit == VVISF::ISFValUnit_Percent) {
+            v /= 100;
           }
+
           val = new VVISF::ISFVal(isfType, v);
-          break;
-        }
-        case UserParamType_Point2D: {
-          A_FloatPoint point;
-          ERR(AEUtil::getPointParam(in_data, out_data, paramIndex, &point));
-          // Since the above getter returns a coordinate considering downsampling, it requries to be compensated
-          // inversely to render an image for Custom Comp UI
-          point.x *= pointScale.width;
-          point.y *= pointScale.height;
-
-          // Should be converted to normalized and vertically-flipped coordinate
-          point.x = point.x / outSize.width;
-          point.y = 1.0 - point.y / outSize.height;
-          val = new VVISF::ISFVal(isfType, point.x, point.y);
-          break;
+        } else {
+          // input->type() == VVISF::ISFValType_Long
+
+          A_FpLong floatIndex = 0.0;
+          ERR(AEUtil::getFloatSliderParam(in_data, out_data, paramIndex, &floatIndex));
+
+          A_long index = (A_long)floatIndex;
+
+          val = new VVISF::ISFVal(isfType, index);
         }
-        case UserParamType_Color: {
-          PF_PixelFloat color;
-          ERR(AEUtil::getColorParam(in_data, out_data, paramIndex, &color));
-          val = new VVISF::ISFVal(isfType, color.red, color.green, color.blue, color.alpha);
-          break;
+        break;
+      }
+      case UserParamType_Angle: {
+        A_FpLong v = 0.0;
+        AEUtil::getAngleParam(in_data, out_data, paramIndex, &v);
+        if (input->unit() == VVISF::ISFValUnit_Direction) {
+          v = (-v + 90.0) * (PI / 180.0);
+        } else {  // unit == VVISF::ISFValUnit_Angle
+          v = -v * (PI / 180.0);
         }
-        case UserParamType_Image:
-          // Assumes the image has already bounded
-          break;
-        default:
-          FX_LOG("Invalid ISFValType.");
-          break;
+        val = new VVISF::ISFVal(isfType, v);
+        break;
       }
-
-      if (val != nullptr) {
-        input->setCurrentVal(*val);
+      case UserParamType_Point2D: {
+        A_FloatPoint point;
+        ERR(AEUtil::getPointParam(in_data, out_data, paramIndex, &point));
+        // Since the above getter returns a coordinate considering downsampling, it requries to be compensated
+        // inversely to render an image for Custom Comp UI
+        point.x *= pointScale.width;
+        point.y *= pointScale.height;
+
+        // Should be converted to normalized and vertically-flipped coordinate
+        point.x = point.x / outSize.width;
+        point.y = 1.0 - point.y / outSize.height;
+        val = new VVISF::ISFVal(isfType, point.x, point.y);
+        break;
+      }
+      case UserParamType_Color: {
+        PF_PixelFloat color;
+        ERR(AEUtil::getColorParam(in_data, out_data, paramIndex, &color));
+        val = new VVISF::ISFVal(isfType, color.red, color.green, color.blue, color.alpha);
+        break;
       }
+      case UserParamType_Image:
+        // Assumes the image has already bounded
+        break;
+      default:
+        FX_LOG("Invalid ISFValType.");
+        break;
+    }
+
+    if (val != nullptr) {
+      input->setCurrentVal(*val);
+    }
 
-      userParamIndex++;
-    }  // End of for each ISF->inputs
+    userParamIndex++;
+  }  // End of for each ISF->inputs
 
-    // Then, render it!
-    scene.renderToBuffer(isfImage, outSize, time);
+  return err;
+}
+
+/**
+ * Renders the region of the scene, which is in AE's coordinates of the whole output, and converts the result to AE's
+ * pixel format. When cropsToRegion is true, the texture only covers the region, otherwise it has the output size.
+ */
+static VVGL::GLBufferRef renderRegionToTexture(RenderContext& renderContext,
+                                               ISF4AEScene& scene,
+                                               short bitdepth,
+                                               const VVGL::Size& outSize,
+                                               double time,
+                                               const PF_Rect& region,
+                                               bool cropsToRegion) {
+  // In After Effects, 16-bit pixel doesn't use the highest bit, and thus each channel ranges 0x0000 - 0x8000.
+  // So after passing pixel buffer to GPU, it should be scaled by (0xffff / 0x8000) to normalize the luminance to
+  // 0.0-1.0.
+  VVISF::ISFVal multiplier16bit(VVISF::ISFValType_Float, bitdepth == 16 ? (65535.0f / 32768.0f) : 1.0f);
+  scene.setMultiplier16bit(multiplier16bit.getDoubleVal());
+  renderContext.ae2glScene->setValueForInputNamed(multiplier16bit, "multiplier16bit");
+  renderContext.gl2aeScene->setValueForInputNamed(multiplier16bit, "multiplier16bit");
+
+  A_long regionWidth = region.right - region.left;
+  A_long regionHeight = region.bottom - region.top;
+  VVGL::Size textureSize = cropsToRegion ? VVGL::Size(regionWidth, regionHeight) : outSize;
+
+  // Render ISF. The scissor and tile rects are in OpenGL's bottom-to-top coordinates.
+  auto isfImage = createRGBATexWithBitdepth(textureSize, renderContext.context, bitdepth);
+
+  if (cropsToRegion) {
+    scene.setScissorRect(VVGL::Rect(0, 0, 0, 0));
+    scene.setTileRect(VVGL::Rect(region.left, outSize.height - region.bottom, regionWidth, regionHeight), outSize);
+  } else {
+    scene.setScissorRect(VVGL::Rect(region.left, outSize.height - region.bottom, regionWidth, regionHeight));
+    scene.setTileRect(VVGL::Rect(0, 0, 0, 0));
+  }
+
+  scene.renderToBuffer(isfImage, outSize, time);
+
+  // Convert the result of ISF
+  if (scene.fusesAEConversion() || convertsAEFormatOnCPU(renderContext, scene)) {
+    // The rows are still in OpenGL's bottom-to-top order. The pixels are already in AE's format unless they're going to
+    // be converted on CPU while being read back.
+    isfImage->flipped = true;
+    return isfImage;
   }
 
-  // Download the result of ISF
-  auto& gl2aeScene = *globalData->gl2aeScene;
+  auto& gl2aeScene = *renderContext.gl2aeScene;
 
   gl2aeScene.setBufferForInputNamed(isfImage, "inputImage");
 
-  auto outputImage = createRGBATexWithBitdepth(outSize, globalData->context, bitdepth);
-  gl2aeScene.renderToBuffer(outputImage);
+  // gl2ae flips the rows, so the region is in the same coordinates as AE
+  if (cropsToRegion) {
+    gl2aeScene.setScissorRect(VVGL::Rect(0, 0, 0, 0));
+  } else {
+    gl2aeScene.setScissorRect(VVGL::Rect(region.left, region.top, regionWidth, regionHeight));
+  }
+
+  auto outTexture = createRGBATexWithBitdepth(textureSize, renderContext.context, bitdepth);
+  gl2aeScene.renderToBuffer(outTexture);
+  outTexture->flipped = false;
 
-  (*outBuffer) = globalData->downloader->downloadTexToCPU(outputImage);
+  return outTexture;
+}
+
+/**
+ * Renders ISF scene to a texture in AE's pixel format. It's used at SmartRender() and DrawEvent(), and assuming image
+ * inputs and the other values are already assigned by the callees. The flipped flag of the texture tells whether its rows are stored from
+ * bottom to top. Only the pixels in the region, which is in AE's coordinates of the whole output, are rendered, so that
+ * coordinates such as gl_FragCoord, isf_FragNormCoord and RENDERSIZE still refer to the whole output.
+ */
+PF_Err renderISFToTexture(PF_InData* in_data,
+                          PF_OutData* out_data,
+                          RenderContext& renderContext,
+                          ISF4AEScene& scene,
+                          short bitdepth,
+                          VVGL::Size& outSize,
+                          double time,
+                          const PF_Rect& region,
+                          VVGL::GLBufferRef* outTexture) {
+  PF_Err err = PF_Err_NONE;
+
+  (*outTexture) = renderRegionToTexture(renderContext, scene, bitdepth, outSize, time, region, false);
 
   // Release resources
   VVGL::GetGlobalBufferPool()->housekeeping();
-  suites.HandleSuite1()->host_unlock_handle(in_data->global_data);
 
   return err;
 }
+
+/**
+ * Decides the size of tiles when a texture of the output size exceeds GL_MAX_TEXTURE_SIZE or MaxTileBytes, and returns
+ * false when the output can be rendered at once, or the scene cannot be rendered tile by tile. The tiles are as wide as
+ * possible so that fewer of them are needed to cover a region.
+ */
+bool getTileSize(const RenderContext& renderContext, ISF4AEScene& scene, short bitdepth, const VVGL::Size& outSize, A_long* tileWidth, A_long* tileHeight) {
+  size_t pixelBytes = bitdepth * 4 / 8;
+  A_long maxSize = renderContext.maxTextureSize > 0 ? renderContext.maxTextureSize : MaxCheckoutLayerSize;
+  A_long width = (A_long)outSize.width;
+  A_long height = (A_long)outSize.height;
+
+  if (width <= maxSize && height <= maxSize && (size_t)width * height * pixelBytes <= MaxTileBytes) {
+    return false;
+  }
+
+  if (!scene.canRenderTiled()) {
+    FX_LOG("The output exceeds the texture limits, but the scene cannot be rendered tile by tile.");
+    return false;
+  }
+
+  // Leave room for the overlap on both sides, and a pixel for aligning the tile to the quads
+  A_long margin = 2 * TileOverlap + 1;
+  A_long maxTileSize = max<A_long>(maxSize - margin, 1);
+  size_t maxRows = MaxTileBytes / ((size_t)(min(width, maxTileSize) + margin) * pixelBytes);
+
+  *tileWidth = min(width, maxTileSize);
+  *tileHeight = (A_long)min<size_t>(maxRows > (size_t)margin ? maxRows - margin : 1, (size_t)min(height, maxTileSize));
+  *tileHeight = max<A_long>(*tileHeight, 1);
+
+  return true;
+}
+
+/**
+ * Renders the region of ISF scene tile by tile, each into a texture slightly larger than the tile, and calls
+ * onTileRendered with the tile in AE's coordinates of the whole output, the texture in AE's pixel format, and the rect of
+ * the tile in the texture. The texture is recycled after the callback, so that only a single tile has to be on GPU at
+ * once. Each tile is rendered with the viewport of its texture, while the coordinates and uniforms still refer to the
+ * whole output. The texture extends beyond the tile by TileOverlap, and its origin is aligned to the 2x2 pixel quads of
+ * the whole output, so that the pixels on the edges of the tile are shaded and differentiated the same as rendering the
+ * output at once.
+ */
+PF_Err renderISFTiles(PF_InData* in_data,
+                      PF_OutData* out_data,
+                      RenderContext& renderContext,
+                      ISF4AEScene& scene,
+                      short bitdepth,
+                      VVGL::Size& outSize,
+                      double time,
+                      const PF_Rect& region,
+                      A_long tileWidth,
+                      A_long tileHeight,
+                      const function<PF_Err(const PF_Rect& tile, const VVGL::GLBufferRef& texture, const PF_Rect& textureRect)>& onTileRendered) {
+  PF_Err err = PF_Err_NONE;
+
+  for (A_long top = region.top; !err && top < region.bottom; top += tileHeight) {
+    for (A_long left = region.left; !err && left < region.right; left += tileWidth) {
+      PF_Rect tile = {left, top, min(left + tileWidth, region.right), min(top + tileHeight, region.bottom)};
+
+      // The rows of the output are counted from the bottom in OpenGL, so the bottom is aligned instead of the top
+      PF_Rect expandedTile = {max<A_long>(tile.left - TileOverlap, 0) & ~1, max<A_long>(tile.top - TileOverlap, 0),
+                              min(tile.right + TileOverlap, (A_long)outSize.width), min(tile.bottom + TileOverlap, (A_long)outSize.height)};
+
+      if (((A_long)outSize.height - expandedTile.bottom) % 2 != 0) {
+        expandedTile.bottom++;
+      }
+
+      PF_Rect textureRect = {tile.left - expandedTile.left, tile.top - expandedTile.top, tile.right - expandedTile.left, tile.bottom - expandedTile.top};
+
+      auto texture = renderRegionToTexture(renderContext, scene, bitdepth, outSize, time, expandedTile, true);
+
+      ERR(onTileRendered(tile, texture, textureRect));
+    }
+
+    VVGL::GetGlobalBufferPool()->housekeeping();
+  }
+
+  scene.setTileRect(VVGL::Rect(0, 0, 0, 0));
+
+  // Release resources
+  VVGL::GetGlobalBufferPool()->housekeeping();
+
+  return err;
+}
+
+/**
+ * Renders ISF scene and synchronously downloads the result to a CPU buffer.
+ */
+PF_Err renderISFToCPUBuffer(PF_InData* in_data,
+                            PF_OutData* out_data,
+                            RenderContext& renderContext,
+                            ISF4AEScene& scene,
+                            short bitdepth,
+                            VVGL::Size& outSize,
+                            VVGL::Size& pointScale,
+                            VVGL::GLBufferRef* outBuffer) {
+  PF_Err err = PF_Err_NONE;
+
+  VVGL::GLBufferRef outputImage = nullptr;
+  PF_Rect region = {0, 0, (A_long)outSize.width, (A_long)outSize.height};
+  double time = 0;
+  ERR(setISFInputValues(in_data, out_data, scene, outSize, pointScale, &time));
+  ERR(renderISFToTexture(in_data, out_data, renderContext, scene, bitdepth, outSize, time, region, &outputImage));
+
+  if (outputImage) {
+    (*outBuffer) = renderContext.downloader->downloadTexToCPU(outputImage);
+    (*outBuffer)->flipped = outputImage->flipped;
+
+    if (convertsAEFormatOnCPU(renderContext, scene)) {
+      auto* pixels = (*outBuffer)->cpuBackingPtr;
+      auto bytesPerRow = (*outBuffer)->calculateBackingBytesPerRow();
+      PixelConvert::convert(PixelConvert::GLToAE, pixels, bytesPerRow, pixels, bytesPerRow, outSize.width, outSize.height, bitdepth, false, renderContext.threadPool);
+    }
+  }
+
+  return err;
+}
+
+/**
+ * Reads the pixels in the region of the texture into the memory, or into the bound pixel pack buffer at the offset.
+ * The region is in AE's coordinates, while the rows are read in the order of the texture.
+ */
+static void readTexturePixels(RenderContext& renderContext, const VVGL::GLBufferRef& texture, const PF_Rect& region, short bitdepth, void* pixels) {
+  A_long y = texture->flipped ? (A_long)texture->size.height - region.bottom : region.top;
+
+  if (!renderContext.readFramebuffer) {
+    glGenFramebuffers(1, &renderContext.readFramebuffer);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, renderContext.readFramebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->name, 0);
+
+  glReadPixels(region.left, y, region.right - region.left, region.bottom - region.top, GL_RGBA, getGLPixelTypeForBitdepth(bitdepth), pixels);
+
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/**
+ * Synchronously reads back the region of the texture straight into the pixels of the effect world by matching the row
+ * pitch, which saves a full-frame buffer and a full-frame copy. Returns false without reading anything when the layout
+ * of the world cannot be described by the pack parameters, or when the rows of the texture have to be reversed.
+ */
+bool downloadTexToEffectWorld(RenderContext& renderContext, const VVGL::GLBufferRef& texture, short bitdepth, const PF_Rect& region, PF_EffectWorld* world) {
+  A_long pixelBytes = bitdepth * 4 / 8;
+
+  if (texture->flipped || world->rowbytes <= 0 || world->rowbytes % pixelBytes != 0 || world->width < region.right - region.left ||
+      world->height < region.bottom - region.top) {
+    return false;
+  }
+
+  glPixelStorei(GL_PACK_ROW_LENGTH, world->rowbytes / pixelBytes);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+  readTexturePixels(renderContext, texture, region, bitdepth, world->data);
+
+  glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  return true;
+}
+
+/**
+ * Copies the mapped pixels of the readback to the effect world, placing the top-left pixel at (left, top) of the world.
+ * The pixels are converted to AE's format on the way when convertsOnCPU is true.
+ */
+void copyReadbackToEffectWorld(RenderContext& renderContext,
+                               const ReadbackBuffer& readback,
+                               const char* pixels,
+                               bool convertsOnCPU,
+                               short bitdepth,
+                               A_long left,
+                               A_long top,
+                               PF_EffectWorld* world) {
+  size_t pixelBytes = bitdepth * 4 / 8;
+  size_t width = readback.bytesPerRow / pixelBytes;
+  char* dst = (char*)world->data + (ptrdiff_t)top * world->rowbytes + (ptrdiff_t)left * pixelBytes;
+
+  if (convertsOnCPU) {
+    PixelConvert::convert(PixelConvert::GLToAE, pixels, readback.bytesPerRow, dst, world->rowbytes, width, readback.height, bitdepth, readback.flipped,
+                          renderContext.threadPool);
+    return;
+  }
+
+  // Copy per row
+  for (size_t y = 0; y < readback.height; y++) {
+    size_t glY = readback.flipped ? (readback.height - 1 - y) : y;
+    const char* glP = pixels + glY * readback.bytesPerRow;  // Pointer offset for OpenGL buffer
+    char* aeP = dst + (ptrdiff_t)y * world->rowbytes;      // for AE's layerDef
+    memcpy(aeP, glP, width * pixelBytes);
+  }
+}
+
+/**
+ * Copies the top-left pixels of the effect world into a frame for the frame cache.
+ */
+shared_ptr<const FrameCache::Frame> copyEffectWorldToFrame(const PF_EffectWorld* world, size_t width, size_t height, short bitdepth) {
+  auto frame = make_shared<FrameCache::Frame>();
+
+  frame->bytesPerRow = width * bitdepth * 4 / 8;
+  frame->height = height;
+  frame->pixels.resize(frame->bytesPerRow * height);
+
+  for (size_t y = 0; y < height; y++) {
+    memcpy(frame->pixels.data() + y * frame->bytesPerRow, (const char*)world->data + (ptrdiff_t)y * world->rowbytes, frame->bytesPerRow);
+  }
+
+  return frame;
+}
+
+void copyFrameToEffectWorld(const FrameCache::Frame& frame, PF_EffectWorld* world) {
+  for (size_t y = 0; y < frame.height; y++) {
+    memcpy((char*)world->data + (ptrdiff_t)y * world->rowbytes, frame.pixels.data() + y * frame.bytesPerRow, frame.bytesPerRow);
+  }
+}
+
+/**
+ * Starts reading back the region of the texture into the next pixel pack buffer of the render context, and returns
+ * immediately without waiting for the GPU. The caller can do other work until it maps the buffer by mapReadback().
+ */
+ReadbackBuffer& beginReadback(RenderContext& renderContext, const VVGL::GLBufferRef& texture, short bitdepth, const PF_Rect& region) {
+  auto& readback = renderContext.readbackBuffers[renderContext.nextReadbackBuffer];
+  renderContext.nextReadbackBuffer = (renderContext.nextReadbackBuffer + 1) % NumReadbackBuffers;
+
+  readback.bytesPerRow = (size_t)(region.right - region.left) * 4 * bitdepth / 8;
+  readback.height = (size_t)(region.bottom - region.top);
+  readback.flipped = texture->flipped;
+
+  size_t size = readback.bytesPerRow * readback.height;
+
+  if (!readback.pbo) {
+    glGenBuffers(1, &readback.pbo);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+
+  if (readback.capacity < size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    readback.capacity = size;
+  }
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+  readTexturePixels(renderContext, texture, region, bitdepth, nullptr);
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+  if (readback.fence) {
+    glDeleteSync(readback.fence);
+  }
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+  // Make sure the commands are submitted while the CPU does something else
+  glFlush();
+
+  return readback;
+}
+
+/**
+ * Waits for the readback to finish and maps the pixels. It returns nullptr on failure. Call unmapReadback() after
+ * copying the pixels.
+ */
+const char* mapReadback(ReadbackBuffer& readback) {
+#ifdef GL_SYNC_GPU_COMMANDS_COMPLETE
+  if (readback.fence) {
+    glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+  }
+#endif
+
+  // Without sync objects, mapping implicitly waits for the readback
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  auto* pixels = reinterpret_cast<const char*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  return pixels;
+}
+
+void unmapReadback(ReadbackBuffer& readback) {
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
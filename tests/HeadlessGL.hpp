@@ -0,0 +1,118 @@
+#pragma once
+
+/**
+ * Creates an OpenGL context without any window through EGL, so that the benchmarks of the GPU paths can run on a
+ * headless machine. Mesa's surfaceless platform is preferred, which doesn't need a display server.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+class HeadlessGL {
+ public:
+  HeadlessGL() {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    _display = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+
+    if (_display == EGL_NO_DISPLAY) {
+      _display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, nullptr, nullptr)) {
+      return;
+    }
+
+    _context = _createContext(EGL_NO_CONTEXT);
+
+    if (_context != EGL_NO_CONTEXT && !makeCurrent(_context)) {
+      eglDestroyContext(_display, _context);
+      _context = EGL_NO_CONTEXT;
+    }
+  }
+
+  ~HeadlessGL() {
+    if (_context != EGL_NO_CONTEXT) {
+      makeCurrent(EGL_NO_CONTEXT);
+      destroyContext(_context);
+    }
+
+    if (_display != EGL_NO_DISPLAY) {
+      eglTerminate(_display);
+    }
+  }
+
+  HeadlessGL(const HeadlessGL&) = delete;
+  HeadlessGL& operator=(const HeadlessGL&) = delete;
+
+  bool isValid() const { return _context != EGL_NO_CONTEXT; }
+
+  /**
+   * Creates a context sharing the textures, buffers and programs with the first one, which can be made current on another
+   * thread as each render context of the plugin does. Returns EGL_NO_CONTEXT on failure.
+   */
+  EGLContext createSharedContext() const { return _createContext(_context); }
+
+  void destroyContext(EGLContext context) const { eglDestroyContext(_display, context); }
+
+  /**
+   * Makes the context current on the calling thread, or releases the current one when EGL_NO_CONTEXT is given.
+   */
+  bool makeCurrent(EGLContext context) const { return eglBindAPI(EGL_OPENGL_API) && eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, context); }
+
+  static string renderer() { return string((const char*)glGetString(GL_RENDERER)) + " (" + (const char*)glGetString(GL_VERSION) + ")"; }
+
+  /**
+   * Compiles and links the program, and returns 0 after printing the log if it fails.
+   */
+  static GLuint createProgram(const char* vsCode, const char* fsCode) {
+    GLuint program = glCreateProgram();
+
+    for (auto& source : {make_pair(GL_VERTEX_SHADER, vsCode), make_pair(GL_FRAGMENT_SHADER, fsCode)}) {
+      GLuint shader = glCreateShader(source.first);
+      glShaderSource(shader, 1, &source.second, nullptr);
+      glCompileShader(shader);
+      glAttachShader(program, shader);
+      glDeleteShader(shader);
+    }
+
+    glLinkProgram(program);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+    if (!linked) {
+      char log[4096] = {};
+      glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+      cerr << "Failed to link the program: " << log << endl;
+      glDeleteProgram(program);
+      return 0;
+    }
+
+    return program;
+  }
+
+ private:
+  EGLDisplay _display = EGL_NO_DISPLAY;
+  EGLContext _context = EGL_NO_CONTEXT;
+
+  // The plugin renders with the compatibility profile as VVGL's GL2 environment does
+  EGLContext _createContext(EGLContext sharedContext) const {
+    // The API is bound per thread, and the contexts may be created on any of the render threads
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      return EGL_NO_CONTEXT;
+    }
+
+    EGLint attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE};
+
+    return eglCreateContext(_display, EGL_NO_CONFIG_KHR, sharedContext, attribs);
+  }
+};
@@ -0,0 +1,253 @@
+/**
+ * Compares the round trip of a full HD frame between AE's and OpenGL's pixel formats on GPU and on CPU, for each bit
+ * depth. The GPU path uploads AE's pixels as they are and converts them by the passes doing the same as ae2gl.fs and
+ * gl2ae.fs, while the CPU path converts them by PixelConvert before uploading and after reading back. Both paths skip the
+ * shader in between, and check that the pixels of AE come back as they are.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "HeadlessGL.hpp"
+#include "PixelConvert.h"
+
+using namespace std;
+
+static const GLsizei Width = 1920;
+static const GLsizei Height = 1080;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+// Fills the frame with pixels within AE's range of the bit depth.
+static void fillAEPixels(vector<uint8_t>& pixels, short bitdepth) {
+  mt19937 random(0);
+
+  switch (bitdepth) {
+    case 8:
+      for (auto& v : pixels) {
+        v = (uint8_t)random();
+      }
+      break;
+    case 16: {
+      auto* values = reinterpret_cast<uint16_t*>(pixels.data());
+      for (size_t i = 0; i < pixels.size() / 2; i++) {
+        values[i] = (uint16_t)(random() % 0x8001);
+      }
+      break;
+    }
+    case 32: {
+      auto* values = reinterpret_cast<float*>(pixels.data());
+      for (size_t i = 0; i < pixels.size() / 4; i++) {
+        values[i] = (float)random() / mt19937::max();
+      }
+      break;
+    }
+  }
+}
+
+// Allows the error of the 16-bit rescaling done in float on GPU.
+static bool isSamePixels(const vector<uint8_t>& a, const vector<uint8_t>& b, short bitdepth) {
+  if (bitdepth != 16) {
+    return a == b;
+  }
+
+  auto* x = reinterpret_cast<const uint16_t*>(a.data());
+  auto* y = reinterpret_cast<const uint16_t*>(b.data());
+
+  for (size_t i = 0; i < a.size() / 2; i++) {
+    if (abs((int)x[i] - (int)y[i]) > 1) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename Func>
+static double measureMBps(size_t bytesPerRun, int runs, Func func) {
+  auto start = chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++) {
+    func();
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  return (double)bytesPerRun * runs / seconds / (1024 * 1024);
+}
+
+static void getGLFormat(short bitdepth, GLint* internalFormat, GLenum* type) {
+  switch (bitdepth) {
+    case 8:
+      *internalFormat = GL_RGBA8;
+      *type = GL_UNSIGNED_BYTE;
+      break;
+    case 16:
+      *internalFormat = GL_RGBA16;
+      *type = GL_UNSIGNED_SHORT;
+      break;
+    default:
+      *internalFormat = GL_RGBA32F;
+      *type = GL_FLOAT;
+      break;
+  }
+}
+
+static GLuint createTexture(short bitdepth) {
+  GLint internalFormat;
+  GLenum type;
+  getGLFormat(bitdepth, &internalFormat, &type);
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, GL_RGBA, type, nullptr);
+
+  return texture;
+}
+
+static const char* QuadVertCode = R"(#version 330 compatibility
+in vec2 position;
+void main() {
+  gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+// The same as ae2gl.fs: reorders ARGB to RGBA, flips the rows and rescales AE's 16-bit range.
+static const char* AE2GLFragCode = R"(#version 330 compatibility
+uniform sampler2D inputImage;
+uniform float multiplier16bit;
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.x, textureSize(inputImage, 0).y - 1 - int(gl_FragCoord.y));
+  gl_FragColor = texelFetch(inputImage, coord, 0).gbar * multiplier16bit;
+}
+)";
+
+// The same as gl2ae.fs: reorders RGBA to ARGB and flips the rows back.
+static const char* GL2AEFragCode = R"(#version 330 compatibility
+uniform sampler2D inputImage;
+uniform float multiplier16bit;
+void main() {
+  ivec2 coord = ivec2(gl_FragCoord.x, textureSize(inputImage, 0).y - 1 - int(gl_FragCoord.y));
+  gl_FragColor = texelFetch(inputImage, coord, 0).argb / multiplier16bit;
+}
+)";
+
+int main() {
+  static const int Runs = 10;
+
+  HeadlessGL gl;
+
+  if (!gl.isValid()) {
+    cout << "Skipped: no OpenGL context is available" << endl;
+    return 0;
+  }
+
+  size_t numThreads = max(thread::hardware_concurrency(), 1u);
+  ThreadPool threadPool(numThreads);
+
+  cout << "Renderer: " << HeadlessGL::renderer() << ", kernel: " << PixelConvert::getKernelName() << " with " << numThreads << " threads, " << Width << "x"
+       << Height << endl;
+
+  GLuint ae2gl = HeadlessGL::createProgram(QuadVertCode, AE2GLFragCode);
+  GLuint gl2ae = HeadlessGL::createProgram(QuadVertCode, GL2AEFragCode);
+  check(ae2gl && gl2ae, "the conversion passes are compiled");
+
+  float quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+  GLuint vao, vbo;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+  GLuint framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glViewport(0, 0, Width, Height);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  for (short bitdepth : {8, 16, 32}) {
+    GLint internalFormat;
+    GLenum type;
+    getGLFormat(bitdepth, &internalFormat, &type);
+
+    size_t rowBytes = (size_t)Width * bitdepth / 2;
+    vector<uint8_t> ae(rowBytes * Height), staging(ae.size()), gpuResult(ae.size()), cpuResult(ae.size());
+    fillAEPixels(ae, bitdepth);
+
+    GLuint aeTexture = createTexture(bitdepth);
+    GLuint glTexture = createTexture(bitdepth);
+    GLuint outTexture = createTexture(bitdepth);
+
+    float multiplier16bit = bitdepth == 16 ? 65535.0f / 32768.0f : 1.0f;
+
+    auto drawPass = [&](GLuint program, GLuint src, GLuint dst) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0);
+      glUseProgram(program);
+      glUniform1f(glGetUniformLocation(program, "multiplier16bit"), multiplier16bit);
+      glBindTexture(GL_TEXTURE_2D, src);
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    };
+
+    auto gpuRoundTrip = [&]() {
+      glBindTexture(GL_TEXTURE_2D, aeTexture);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_RGBA, type, ae.data());
+
+      drawPass(ae2gl, aeTexture, glTexture);
+      drawPass(gl2ae, glTexture, outTexture);
+
+      glReadPixels(0, 0, Width, Height, GL_RGBA, type, gpuResult.data());
+    };
+
+    auto cpuRoundTrip = [&]() {
+      PixelConvert::convert(PixelConvert::AEToGL, ae.data(), rowBytes, staging.data(), rowBytes, Width, Height, bitdepth, true, &threadPool);
+
+      glBindTexture(GL_TEXTURE_2D, glTexture);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_RGBA, type, staging.data());
+
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, glTexture, 0);
+      glReadPixels(0, 0, Width, Height, GL_RGBA, type, staging.data());
+
+      PixelConvert::convert(PixelConvert::GLToAE, staging.data(), rowBytes, cpuResult.data(), rowBytes, Width, Height, bitdepth, true, &threadPool);
+    };
+
+    gpuRoundTrip();
+    cpuRoundTrip();
+    check(glGetError() == GL_NO_ERROR, "no GL error occurs");
+    check(isSamePixels(gpuResult, ae, bitdepth), "the GPU passes give back AE's pixels");
+    check(cpuResult == ae, "the CPU kernels give back AE's pixels");
+
+    double gpuMBps = measureMBps(ae.size(), Runs, gpuRoundTrip);
+    double cpuMBps = measureMBps(ae.size(), Runs, cpuRoundTrip);
+
+    cout << bitdepth << "-bit round trip: GPU " << gpuMBps << " MB/s, CPU " << cpuMBps << " MB/s (" << (cpuMBps > gpuMBps ? "CPU" : "GPU") << " wins)" << endl;
+
+    glDeleteTextures(1, &aeTexture);
+    glDeleteTextures(1, &glTexture);
+    glDeleteTextures(1, &outTexture);
+  }
+
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteProgram(ae2gl);
+  glDeleteProgram(gl2ae);
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * Measures the throughput of flattening and unflattening the ISF parameter, the work AE does per instance when a project
+ * is saved and opened. The shaders are read from the files given as arguments.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "FlatIsf.hpp"
+
+using namespace std;
+
+template <typename Func>
+static double measureMBps(size_t bytesPerRun, int runs, Func func) {
+  auto start = chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++) {
+    func();
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  return (double)bytesPerRun * runs / seconds / (1024 * 1024);
+}
+
+int main(int argc, char* argv[]) {
+  static const int Runs = 2000;
+
+  if (argc < 2) {
+    cerr << "Usage: bench_flat_isf <shader>..." << endl;
+    return 1;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    ifstream file(argv[i], ios::binary);
+    if (!file) {
+      cerr << "Cannot open " << argv[i] << endl;
+      return 1;
+    }
+
+    string fsCode((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    string vsCode = "";
+    string name = argv[i];
+    auto digest = getSourceDigest(fsCode, vsCode);
+
+    vector<char> compressed;
+    double compressMBps = measureMBps(fsCode.size(), Runs, [&]() { compressed = LZ::compress(fsCode.data(), fsCode.size()); });
+
+    vector<char> data(FlatIsf::getV2Size(name, compressed));
+    FlatIsf::writeV2(data.data(), name, compressed, fsCode.size(), vsCode.size(), digest);
+
+    FlatIsf::Data flat;
+    double parseMBps = measureMBps(fsCode.size(), Runs, [&]() {
+      flat = FlatIsf::Data();
+      FlatIsf::parse(data.data(), data.size(), &flat);
+    });
+
+    if (flat.name != name || flat.fsCode != fsCode || flat.vsCode != vsCode) {
+      cerr << "The codes of " << argv[i] << " are not read back as they are" << endl;
+      return 1;
+    }
+
+    // The instances sharing a shader only read the header
+    double cachedMBps = measureMBps(fsCode.size(), Runs, [&]() {
+      flat = FlatIsf::Data();
+      FlatIsf::parse(data.data(), data.size(), &flat, [](const Digest128&) { return true; });
+    });
+
+    cout << argv[i] << ": " << fsCode.size() << " -> " << compressed.size() << " bytes, compress " << compressMBps << " MB/s, parse " << parseMBps
+         << " MB/s, parse cached " << cachedMBps << " MB/s" << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * Measures the throughput of PixelConvert::convert() for a full HD frame of each bit depth, with and without the thread
+ * pool, and checks that converting to OpenGL's format and back gives the same pixels of AE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "PixelConvert.h"
+
+using namespace std;
+
+static const size_t Width = 1920;
+static const size_t Height = 1080;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+// Fills the frame with pixels within AE's range of the bit depth.
+static void fillAEPixels(vector<uint8_t>& pixels, short bitdepth) {
+  mt19937 random(0);
+
+  switch (bitdepth) {
+    case 8:
+      for (auto& v : pixels) {
+        v = (uint8_t)random();
+      }
+      break;
+    case 16: {
+      auto* values = reinterpret_cast<uint16_t*>(pixels.data());
+      for (size_t i = 0; i < pixels.size() / 2; i++) {
+        values[i] = (uint16_t)(random() % 0x8001);
+      }
+      break;
+    }
+    case 32: {
+      auto* values = reinterpret_cast<float*>(pixels.data());
+      for (size_t i = 0; i < pixels.size() / 4; i++) {
+        values[i] = (float)random() / mt19937::max();
+      }
+      break;
+    }
+  }
+}
+
+template <typename Func>
+static double measureMBps(size_t bytesPerRun, int runs, Func func) {
+  auto start = chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++) {
+    func();
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  return (double)bytesPerRun * runs / seconds / (1024 * 1024);
+}
+
+// Converts the odd widths as well, which leave the tail of each row to the scalar kernel.
+static void checkRoundTrip(short bitdepth, size_t width, size_t height) {
+  size_t rowBytes = width * bitdepth / 2;
+  vector<uint8_t> ae(rowBytes * height), gl(ae.size()), back(ae.size());
+  fillAEPixels(ae, bitdepth);
+
+  PixelConvert::convert(PixelConvert::AEToGL, ae.data(), rowBytes, gl.data(), rowBytes, width, height, bitdepth, true, nullptr);
+  PixelConvert::convert(PixelConvert::GLToAE, gl.data(), rowBytes, back.data(), rowBytes, width, height, bitdepth, true, nullptr);
+
+  check(back == ae, "AE's pixels are converted back as they are");
+
+  // The alpha of the last row of AE comes fourth in the first row of OpenGL, which is rescaled in 16-bit
+  if (bitdepth != 16) {
+    size_t channelBytes = bitdepth / 8;
+    check(memcmp(&gl[3 * channelBytes], &ae[(height - 1) * rowBytes], channelBytes) == 0, "ARGB is reordered to RGBA and flipped");
+  }
+}
+
+int main() {
+  static const int Runs = 20;
+
+  size_t numThreads = max(thread::hardware_concurrency(), 1u);
+  ThreadPool threadPool(numThreads);
+
+  cout << "Kernel: " << PixelConvert::getKernelName() << ", " << Width << "x" << Height << endl;
+
+  for (short bitdepth : {8, 16, 32}) {
+    for (size_t width : {1, 3, 7, 17, 33, 65}) {
+      checkRoundTrip(bitdepth, width, 5);
+    }
+
+    size_t rowBytes = Width * bitdepth / 2;
+    vector<uint8_t> src(rowBytes * Height), dst(src.size()), threadedDst(src.size());
+    fillAEPixels(src, bitdepth);
+
+    for (auto direction : {PixelConvert::AEToGL, PixelConvert::GLToAE}) {
+      double singleMBps = measureMBps(src.size(), Runs, [&]() {
+        PixelConvert::convert(direction, src.data(), rowBytes, dst.data(), rowBytes, Width, Height, bitdepth, false, nullptr);
+      });
+
+      double threadedMBps = measureMBps(src.size(), Runs, [&]() {
+        PixelConvert::convert(direction, src.data(), rowBytes, threadedDst.data(), rowBytes, Width, Height, bitdepth, false, &threadPool);
+      });
+
+      check(dst == threadedDst, "the thread pool converts the same pixels");
+
+      cout << bitdepth << "-bit " << (direction == PixelConvert::AEToGL ? "AE to GL" : "GL to AE") << ": " << singleMBps << " MB/s, "
+           << threadedMBps << " MB/s with " << numThreads << " threads" << endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,249 @@
+/**
+ * Compares building the programs of the shaders from cold, by compiling and linking them and storing their binaries by
+ * ProgramBinaryCache as the first launch of AE does, with building them warm, by loading the binaries with a new cache
+ * on the same directory as the next launch does. The programs loaded have to render the same as the ones compiled. It
+ * also checks that a corrupted binary is rejected and deleted, so that the shader is compiled as usual.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FlatIsf.hpp"
+#include "HeadlessGL.hpp"
+#include "ProgramBinaryCache.hpp"
+
+using namespace std;
+
+static const GLsizei Width = 64;
+static const GLsizei Height = 64;
+static const int NumPrograms = 20;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+// SystemUtil.cpp also has the file dialogs written in Objective-C++ on macOS, so the functions used by the cache are
+// defined here the same as it does.
+namespace SystemUtil {
+
+bool readBinaryFile(const string& path, vector<char>& data) {
+  ifstream file(path, ios::binary | ios::ate);
+
+  if (!file) {
+    return false;
+  }
+
+  auto size = file.tellg();
+
+  if (size < 0) {
+    return false;
+  }
+
+  data.resize((size_t)size);
+  file.seekg(0);
+
+  return (bool)file.read(data.data(), size);
+}
+
+bool writeBinaryFileAtomically(const string& path, const void* data, size_t size) {
+  stringstream tmpPath;
+  tmpPath << path << ".tmp" << hash<thread::id>()(this_thread::get_id());
+
+  {
+    ofstream file(tmpPath.str(), ios::binary | ios::trunc);
+
+    if (!file || !file.write(reinterpret_cast<const char*>(data), size)) {
+      return false;
+    }
+  }
+
+  error_code ec;
+  filesystem::rename(tmpPath.str(), path, ec);
+
+  if (ec) {
+    filesystem::remove(tmpPath.str(), ec);
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace SystemUtil
+
+static const char* QuadVertCode = R"(#version 330 compatibility
+in vec2 position;
+void main() {
+  gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+// Makes a generator different for each index, with some loops and functions for the compiler to work on. The run is
+// written in the code, since Mesa keeps its own cache of the shaders which would make the cold runs after the first warm.
+static string makeFragCode(int index, long long run) {
+  stringstream code;
+
+  code << "#version 330 compatibility\n"
+       << "// Run " << run << "\n"
+       << "uniform vec2 RENDERSIZE;\n"
+       << "float wave(vec2 p, float k) {\n"
+       << "  return sin(dot(p, vec2(k, " << index + 1 << ".0)) * 3.7) * 0.5 + 0.5;\n"
+       << "}\n"
+       << "void main() {\n"
+       << "  vec2 uv = gl_FragCoord.xy / RENDERSIZE;\n"
+       << "  vec3 color = vec3(0.0);\n"
+       << "  for (int i = 0; i < " << 4 + index % 5 << "; i++) {\n"
+       << "    color += vec3(wave(uv, float(i)), wave(uv.yx, " << index * 0.25 << "), wave(uv * 2.0, float(i) * 0.5)) / "
+       << 4 + index % 5 << ".0;\n"
+       << "    uv = fract(uv * 1.3 + vec2(0.1, " << index * 0.01 << "));\n"
+       << "  }\n"
+       << "  gl_FragColor = vec4(color, 1.0);\n"
+       << "}\n";
+
+  return code.str();
+}
+
+static vector<uint8_t> renderProgram(GLuint program) {
+  glUseProgram(program);
+  glUniform2f(glGetUniformLocation(program, "RENDERSIZE"), Width, Height);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  vector<uint8_t> pixels((size_t)Width * Height * 4);
+  glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  return pixels;
+}
+
+template <typename Func>
+static double measureMs(Func func) {
+  auto start = chrono::steady_clock::now();
+  func();
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  HeadlessGL gl;
+
+  if (!gl.isValid()) {
+    cout << "Skipped: no OpenGL context is available" << endl;
+    return 0;
+  }
+
+  long long run = chrono::steady_clock::now().time_since_epoch().count();
+  auto directory = filesystem::temp_directory_path() / ("bench_program_binary_" + to_string(run));
+  filesystem::create_directories(directory);
+
+  {
+    ProgramBinaryCache coldCache(directory.string(), SIZE_MAX);
+
+    if (!coldCache.isSupported()) {
+      cout << "Skipped: program binaries aren't supported by " << HeadlessGL::renderer() << endl;
+      filesystem::remove_all(directory);
+      return 0;
+    }
+
+    cout << "Renderer: " << HeadlessGL::renderer() << ", " << NumPrograms << " programs" << endl;
+
+    float quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+    GLuint vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    GLuint texture, framebuffer;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glViewport(0, 0, Width, Height);
+
+    vector<string> fsCodes;
+    vector<Digest128> digests;
+    for (int i = 0; i < NumPrograms; i++) {
+      fsCodes.push_back(makeFragCode(i, run));
+      digests.push_back(getSourceDigest(fsCodes.back(), QuadVertCode));
+    }
+
+    // As the first launch: nothing is stored yet, so every program is compiled and stored
+    vector<GLuint> compiled(NumPrograms);
+    double coldMs = measureMs([&]() {
+      for (int i = 0; i < NumPrograms; i++) {
+        check(coldCache.load(digests[i]) == 0, "nothing is stored before the first launch");
+        compiled[i] = HeadlessGL::createProgram(QuadVertCode, fsCodes[i].c_str());
+        check(compiled[i] != 0, "the shader is compiled");
+        coldCache.store(digests[i], compiled[i]);
+      }
+    });
+
+    // As the next launch: the binaries are read by a new cache
+    ProgramBinaryCache warmCache(directory.string(), SIZE_MAX);
+    vector<GLuint> loaded(NumPrograms);
+    double warmMs = measureMs([&]() {
+      for (int i = 0; i < NumPrograms; i++) {
+        loaded[i] = warmCache.load(digests[i]);
+        check(loaded[i] != 0, "the stored binary is loaded");
+      }
+    });
+
+    for (int i = 0; i < NumPrograms; i++) {
+      check(renderProgram(compiled[i]) == renderProgram(loaded[i]), "the loaded program renders the same as the compiled one");
+    }
+
+    // A corrupted binary has to be rejected by the driver and deleted, instead of being loaded again on every launch
+    vector<filesystem::path> files;
+    for (auto& file : filesystem::directory_iterator(directory)) {
+      files.push_back(file.path());
+    }
+    check(files.size() == (size_t)NumPrograms, "a binary is stored for each program");
+
+    for (auto& file : files) {
+      vector<char> data;
+      check(SystemUtil::readBinaryFile(file.string(), data), "the binary is read");
+
+      // Leave the header as it is so that the driver is asked to link it
+      for (size_t i = 16; i < data.size(); i++) {
+        data[i] = (char)~data[i];
+      }
+      check(SystemUtil::writeBinaryFileAtomically(file.string(), data.data(), data.size()), "the binary is corrupted");
+    }
+
+    for (int i = 0; i < NumPrograms; i++) {
+      check(warmCache.load(digests[i]) == 0, "the corrupted binary is rejected");
+    }
+    check(filesystem::is_empty(directory), "the rejected binaries are deleted");
+    check(glGetError() == GL_NO_ERROR, "no GL error occurs");
+
+    cout << "Cold (compile, link and store): " << coldMs / NumPrograms << " ms per program" << endl;
+    cout << "Warm (load the binary): " << warmMs / NumPrograms << " ms per program" << endl;
+
+    for (int i = 0; i < NumPrograms; i++) {
+      glDeleteProgram(compiled[i]);
+      glDeleteProgram(loaded[i]);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+  }
+
+  filesystem::remove_all(directory);
+
+  return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * Compares the ways of reading back a full HD frame into an effect world whose rows are padded, for each bit depth. The
+ * direct path reads straight into the world by setting GL_PACK_ROW_LENGTH from its pitch as downloadTexToEffectWorld()
+ * does, while the others read into a buffer packed tightly and copy per row as copyReadbackToEffectWorld() does: either
+ * synchronously into memory of the client, or through a pixel pack buffer waited by a fence as beginReadback() and
+ * mapReadback() do. A world whose pitch isn't a whole number of pixels can only be read by the latter, which is checked
+ * as the fallback. All of the paths have to fill the world the same and leave its padding as it is.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "HeadlessGL.hpp"
+
+using namespace std;
+
+static const GLsizei Width = 1920;
+static const GLsizei Height = 1080;
+static const uint8_t PaddingByte = 0xcd;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+template <typename Func>
+static double measureMBps(size_t bytesPerRun, int runs, Func func) {
+  auto start = chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++) {
+    func();
+  }
+
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  return (double)bytesPerRun * runs / seconds / (1024 * 1024);
+}
+
+static void getGLFormat(short bitdepth, GLint* internalFormat, GLenum* type) {
+  switch (bitdepth) {
+    case 8:
+      *internalFormat = GL_RGBA8;
+      *type = GL_UNSIGNED_BYTE;
+      break;
+    case 16:
+      *internalFormat = GL_RGBA16;
+      *type = GL_UNSIGNED_SHORT;
+      break;
+    default:
+      *internalFormat = GL_RGBA32F;
+      *type = GL_FLOAT;
+      break;
+  }
+}
+
+/**
+ * A stand-in of PF_EffectWorld, whose rows are followed by the padding.
+ */
+struct World {
+  size_t rowbytes;
+  vector<uint8_t> data;
+
+  World(size_t rowbytes) : rowbytes(rowbytes), data(rowbytes * Height, PaddingByte) {}
+};
+
+// The same as copyReadbackToEffectWorld() without the conversion
+static void copyPerRow(const uint8_t* pixels, size_t bytesPerRow, World& world) {
+  for (size_t y = 0; y < (size_t)Height; y++) {
+    memcpy(world.data.data() + y * world.rowbytes, pixels + y * bytesPerRow, bytesPerRow);
+  }
+}
+
+int main() {
+  static const int Runs = 10;
+
+  HeadlessGL gl;
+
+  if (!gl.isValid()) {
+    cout << "Skipped: no OpenGL context is available" << endl;
+    return 0;
+  }
+
+  cout << "Renderer: " << HeadlessGL::renderer() << ", " << Width << "x" << Height << endl;
+
+  GLuint framebuffer, pbo;
+  glGenFramebuffers(1, &framebuffer);
+  glGenBuffers(1, &pbo);
+
+  for (short bitdepth : {8, 16, 32}) {
+    GLint internalFormat;
+    GLenum type;
+    getGLFormat(bitdepth, &internalFormat, &type);
+
+    size_t pixelBytes = bitdepth * 4 / 8;
+    size_t bytesPerRow = Width * pixelBytes;
+
+    // Any bit pattern is fine for the integer formats, but the floats are kept finite so that they're compared as they are
+    vector<uint8_t> pixels(bytesPerRow * Height);
+    for (size_t i = 0; i < pixels.size(); i++) {
+      pixels[i] = (uint8_t)(i * 31 + i / 7919);
+    }
+    if (bitdepth == 32) {
+      auto* values = reinterpret_cast<float*>(pixels.data());
+      for (size_t i = 0; i < pixels.size() / 4; i++) {
+        values[i] = (float)(i % 1009) / 1008.0f;
+      }
+    }
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, GL_RGBA, type, pixels.data());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, pixels.size(), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // AE pads the rows of a world, by some pixels or by bytes not making up a pixel
+    World expected(bytesPerRow + 64 * pixelBytes), direct(expected.rowbytes), synced(expected.rowbytes), buffered(expected.rowbytes);
+    World unaligned(bytesPerRow + 2), unalignedExpected(unaligned.rowbytes);
+    copyPerRow(pixels.data(), bytesPerRow, expected);
+    copyPerRow(pixels.data(), bytesPerRow, unalignedExpected);
+
+    vector<uint8_t> staging(pixels.size());
+
+    auto readDirectly = [&](World& world) {
+      check(world.rowbytes % pixelBytes == 0, "the pitch is a whole number of pixels");
+      glPixelStorei(GL_PACK_ROW_LENGTH, (GLint)(world.rowbytes / pixelBytes));
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, Width, Height, GL_RGBA, type, world.data.data());
+      glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+      glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    };
+
+    auto readSynced = [&](World& world) {
+      glReadPixels(0, 0, Width, Height, GL_RGBA, type, staging.data());
+      copyPerRow(staging.data(), bytesPerRow, world);
+    };
+
+    auto readThroughPbo = [&](World& world) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+      glReadPixels(0, 0, Width, Height, GL_RGBA, type, nullptr);
+      GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
+
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      glDeleteSync(fence);
+
+      auto* mapped = reinterpret_cast<const uint8_t*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+      check(mapped != nullptr, "the pixel pack buffer is mapped");
+      copyPerRow(mapped, bytesPerRow, world);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    };
+
+    readDirectly(direct);
+    readSynced(synced);
+    readThroughPbo(buffered);
+    readThroughPbo(unaligned);
+    check(glGetError() == GL_NO_ERROR, "no GL error occurs");
+    check(direct.data == expected.data, "the direct readback fills the world and leaves the padding");
+    check(synced.data == expected.data, "the synchronous readback fills the world and leaves the padding");
+    check(buffered.data == expected.data, "the readback through the pixel pack buffer fills the world and leaves the padding");
+    check(unaligned.data == unalignedExpected.data, "the fallback fills the world whose pitch isn't a whole number of pixels");
+
+    double directMBps = measureMBps(pixels.size(), Runs, [&]() { readDirectly(direct); });
+    double syncedMBps = measureMBps(pixels.size(), Runs, [&]() { readSynced(synced); });
+    double pboMBps = measureMBps(pixels.size(), Runs, [&]() { readThroughPbo(buffered); });
+    double unalignedMBps = measureMBps(pixels.size(), Runs, [&]() { readThroughPbo(unaligned); });
+
+    cout << bitdepth << "-bit readback: direct " << directMBps << " MB/s, synchronous and copy " << syncedMBps << " MB/s, pixel pack buffer and copy "
+         << pboMBps << " MB/s, fallback for the unaligned pitch " << unalignedMBps << " MB/s" << endl;
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glDeleteTextures(1, &texture);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteBuffers(1, &pbo);
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * Measures how the frames per second scale with the number of render threads in a mock host, which calls a stand-in of
+ * SmartRender from each thread as AE does with Multi-Frame Rendering. Each call checks out a render context with its own
+ * GL context from ResourcePool, uploads a layer, renders a shader and reads the frame back. It's compared with all of
+ * the threads sharing a single context behind a lock, and the frames rendered by both are checked to be the same.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "HeadlessGL.hpp"
+#include "ResourcePool.hpp"
+
+using namespace std;
+
+static const GLsizei Width = 1280;
+static const GLsizei Height = 720;
+static const int FramesPerThread = 8;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+static const char* QuadVertCode = R"(#version 330 compatibility
+in vec2 position;
+void main() {
+  gl_Position = vec4(position, 0.0, 1.0);
+}
+)";
+
+// Some arithmetic per pixel on top of sampling the layer, like a typical generator or filter.
+static const char* FilterFragCode = R"(#version 330 compatibility
+uniform sampler2D inputImage;
+uniform float time;
+void main() {
+  vec2 uv = gl_FragCoord.xy / vec2(textureSize(inputImage, 0));
+  vec4 color = texture(inputImage, uv);
+  for (int i = 0; i < 16; i++) {
+    color.rgb = fract(color.rgb * 1.7 + sin(uv.yxx * float(i) + time));
+  }
+  gl_FragColor = color;
+}
+)";
+
+/**
+ * A stand-in of RenderContext, whose GL objects are created on its own context as the plugin does.
+ */
+struct MockRenderContext {
+  const HeadlessGL* gl;
+  EGLContext context;
+  GLuint program = 0, vao = 0, vbo = 0, inputTexture = 0, outputTexture = 0, framebuffer = 0;
+
+  MockRenderContext(const HeadlessGL* gl) : gl(gl), context(gl->createSharedContext()) {
+    check(context != EGL_NO_CONTEXT && gl->makeCurrent(context), "a shared context is created");
+
+    program = HeadlessGL::createProgram(QuadVertCode, FilterFragCode);
+    check(program != 0, "the filter is compiled");
+
+    float quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    for (auto* texture : {&inputTexture, &outputTexture}) {
+      glGenTextures(1, texture);
+      glBindTexture(GL_TEXTURE_2D, *texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+
+    gl->makeCurrent(EGL_NO_CONTEXT);
+  }
+
+  // The objects are kept by the share group even after the context is destroyed
+  ~MockRenderContext() {
+    gl->makeCurrent(context);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &inputTexture);
+    glDeleteTextures(1, &outputTexture);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+    gl->makeCurrent(EGL_NO_CONTEXT);
+
+    gl->destroyContext(context);
+  }
+
+  // Does what SmartRender does on GPU: upload the layer, render and read back the frame.
+  void render(const vector<uint8_t>& layer, float time, vector<uint8_t>& frame) {
+    glBindTexture(GL_TEXTURE_2D, inputTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, Width, Height);
+    glUseProgram(program);
+    glUniform1f(glGetUniformLocation(program, "time"), time);
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, frame.data());
+  }
+};
+
+/**
+ * Renders the frames from the threads, and returns the frames per second. Each frame is checked against the reference
+ * rendered at the same time.
+ */
+template <typename RenderFunc>
+static double renderFrames(int numThreads, const vector<vector<uint8_t>>& references, RenderFunc render) {
+  vector<thread> threads;
+  atomic<int> nextFrame{0};
+  int numFrames = numThreads * FramesPerThread;
+
+  auto start = chrono::steady_clock::now();
+
+  for (int t = 0; t < numThreads; t++) {
+    threads.emplace_back([&]() {
+      vector<uint8_t> frame((size_t)Width * Height * 4);
+
+      for (int i = nextFrame++; i < numFrames; i = nextFrame++) {
+        render(i % FramesPerThread, frame);
+        check(frame == references[i % FramesPerThread], "the frame is the same as the reference");
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return numFrames / chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  HeadlessGL gl;
+
+  if (!gl.isValid()) {
+    cout << "Skipped: no OpenGL context is available" << endl;
+    return 0;
+  }
+
+  cout << "Renderer: " << HeadlessGL::renderer() << ", " << thread::hardware_concurrency() << " hardware threads, " << Width << "x" << Height << endl;
+
+  vector<uint8_t> layer((size_t)Width * Height * 4);
+  for (size_t i = 0; i < layer.size(); i++) {
+    layer[i] = (uint8_t)(i * 7 + i / 4093);
+  }
+
+  // Render the references on a context of their own
+  vector<vector<uint8_t>> references(FramesPerThread, vector<uint8_t>(layer.size()));
+  {
+    MockRenderContext renderContext(&gl);
+    gl.makeCurrent(renderContext.context);
+
+    for (int i = 0; i < FramesPerThread; i++) {
+      renderContext.render(layer, (float)i, references[i]);
+    }
+
+    check(glGetError() == GL_NO_ERROR, "no GL error occurs");
+    gl.makeCurrent(EGL_NO_CONTEXT);
+  }
+
+  size_t maxThreads = max<size_t>(thread::hardware_concurrency(), 4);
+
+  for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    // As before the pool: every thread waits for the single context
+    MockRenderContext sharedRenderContext(&gl);
+    mutex lock;
+
+    double lockedFps = renderFrames((int)numThreads, references, [&](int frameIndex, vector<uint8_t>& frame) {
+      lock_guard<mutex> guard(lock);
+      gl.makeCurrent(sharedRenderContext.context);
+      sharedRenderContext.render(layer, (float)frameIndex, frame);
+      gl.makeCurrent(EGL_NO_CONTEXT);
+    });
+
+    // Each thread checks out a context of its own, which is created lazily up to the number of threads
+    ResourcePool<MockRenderContext> renderContexts([&gl]() { return make_shared<MockRenderContext>(&gl); }, numThreads);
+
+    double pooledFps = renderFrames((int)numThreads, references, [&](int frameIndex, vector<uint8_t>& frame) {
+      auto renderContext = renderContexts.checkout();
+      gl.makeCurrent(renderContext->context);
+      renderContext->render(layer, (float)frameIndex, frame);
+      gl.makeCurrent(EGL_NO_CONTEXT);
+      renderContexts.checkin(renderContext);
+    });
+
+    cout << numThreads << " threads: " << pooledFps << " fps with the pool, " << lockedFps << " fps with a single context" << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * Compares looking up the scene cache keyed by the 128-bit digest of the source with keying it by the source itself. The
+ * lookups are measured both from the source, as getCompiledSceneDesc() does for every instance, and from the key already
+ * known, as the compiled desc is stored back. The shaders are read from the files given as arguments.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "FlatIsf.hpp"
+#include "LRUCache.hpp"
+
+using namespace std;
+
+struct Value {
+  size_t size;
+};
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+template <typename Func>
+static double measureNsPerCall(int runs, Func func) {
+  auto start = chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++) {
+    func(i);
+  }
+
+  return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / runs;
+}
+
+int main(int argc, char* argv[]) {
+  static const int Runs = 200000;
+
+  if (argc < 2) {
+    cerr << "Usage: bench_scene_key_lookup <shader>..." << endl;
+    return 1;
+  }
+
+  vector<string> sources;
+  size_t totalBytes = 0;
+
+  for (int i = 1; i < argc; i++) {
+    ifstream file(argv[i], ios::binary);
+    if (!file) {
+      cerr << "Cannot open " << argv[i] << endl;
+      return 1;
+    }
+
+    sources.emplace_back(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    totalBytes += sources.back().size();
+  }
+
+  auto sizeOf = [](const Value& value) { return value.size; };
+
+  LRUCache<Digest128, Value, Digest128Hash> digestCache(sizeOf, SIZE_MAX / 2);
+  LRUCache<string, Value> sourceCache(sizeOf, SIZE_MAX / 2);
+
+  // The samples only have fragment shaders. Keyed by the source, the codes have to be concatenated as the digest covers
+  // both of them.
+  string vsCode;
+  vector<Digest128> digests;
+
+  for (auto& source : sources) {
+    auto value = make_shared<Value>(Value{source.size()});
+    digests.push_back(getSourceDigest(source, vsCode));
+    digestCache.set(digests.back(), value);
+    sourceCache.set(source + vsCode, value);
+  }
+
+  size_t numSources = sources.size();
+
+  // From the source, as the instances are loaded: the digest has to be computed, while the string is hashed by the map
+  double digestFromSource = measureNsPerCall(Runs, [&](int i) {
+    auto& source = sources[i % numSources];
+    check(digestCache.get(getSourceDigest(source, vsCode)) != nullptr, "the digest of the source hits");
+  });
+
+  double stringFromSource = measureNsPerCall(Runs, [&](int i) {
+    auto& source = sources[i % numSources];
+    check(sourceCache.get(source + vsCode) != nullptr, "the source hits");
+  });
+
+  // From the key kept by the desc
+  double digestFromKey = measureNsPerCall(Runs, [&](int i) { check(digestCache.get(digests[i % numSources]) != nullptr, "the digest hits"); });
+
+  double stringFromKey = measureNsPerCall(Runs, [&](int i) { check(sourceCache.get(sources[i % numSources]) != nullptr, "the source hits"); });
+
+  cout << numSources << " shaders, " << totalBytes / numSources << " bytes on average" << endl;
+  cout << "From the source: digest " << digestFromSource << " ns, string " << stringFromSource << " ns" << endl;
+  cout << "From the key: digest " << digestFromKey << " ns, string " << stringFromKey << " ns" << endl;
+  cout << "Key bytes held by the cache: digest " << numSources * sizeof(Digest128) << ", string " << totalBytes << endl;
+
+  return 0;
+}
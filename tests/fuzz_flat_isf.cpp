@@ -0,0 +1,126 @@
+/**
+ * Fuzz driver for FlatIsf::parse(), which reads the ISF parameter from bytes saved in a project. Build it with
+ * -DISF4AE_LIBFUZZER=ON under Clang for libFuzzer. Otherwise it runs each file given as an argument, or stdin for AFL,
+ * and "--mutate <count>" feeds a deterministic series of corrupted buffers as a smoke test.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+#include "FlatIsf.hpp"
+
+using namespace std;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  auto* bytes = reinterpret_cast<const char*>(data);
+
+  FlatIsf::Data flat;
+  if (FlatIsf::parse(bytes, size, &flat) && !flat.fsCode.empty() && bytes[0] == ARB_ISF_FLAT_V2_MAGIC_NUMBER) {
+    check(getSourceDigest(flat.fsCode, flat.vsCode) == flat.digest, "the decompressed codes match the digest");
+  }
+
+  // The path skipping decompression for the shaders already loaded
+  FlatIsf::Data cached;
+  FlatIsf::parse(bytes, size, &cached, [](const Digest128&) { return true; });
+
+  return 0;
+}
+
+#ifndef ISF4AE_LIBFUZZER
+
+static vector<char> makeValidV2() {
+  string name = "Fuzz Shader";
+  string fsCode = "/*{\"INPUTS\":[{\"NAME\":\"amount\",\"TYPE\":\"float\"}]}*/\nvoid main() {\n  gl_FragColor = vec4(amount);\n}\n";
+  string vsCode = "void main() {\n  isf_vertShaderInit();\n}\n";
+
+  string code = fsCode + vsCode;
+  auto compressed = LZ::compress(code.data(), code.size());
+
+  vector<char> data(FlatIsf::getV2Size(name, compressed));
+  FlatIsf::writeV2(data.data(), name, compressed, fsCode.size(), vsCode.size(), getSourceDigest(fsCode, vsCode));
+
+  FlatIsf::Data flat;
+  check(FlatIsf::parse(data.data(), data.size(), &flat), "the valid data is parsed");
+  check(flat.name == name && flat.fsCode == fsCode && flat.vsCode == vsCode, "the codes are read back as they are");
+
+  return data;
+}
+
+static void runMutations(int count) {
+  auto valid = makeValidV2();
+  mt19937 random(0);
+
+  for (int i = 0; i < count; i++) {
+    auto data = valid;
+
+    switch (random() % 4) {
+      case 0:
+        // Truncated, such as a partial autosave
+        data.resize(random() % data.size());
+        break;
+      case 1:
+        // Flipped bits anywhere
+        for (int k = random() % 8 + 1; k > 0; k--) {
+          data[random() % data.size()] ^= (char)(1 << (random() % 8));
+        }
+        break;
+      case 2: {
+        // Arbitrary offsets and sizes in the header
+        uint32_t value = random() % 2 ? (uint32_t)random() : (uint32_t)(random() % (data.size() * 2));
+        size_t field = 4 + (random() % 5) * sizeof(uint32_t);
+        memcpy(&data[field], &value, sizeof(value));
+        break;
+      }
+      default:
+        // Another version with the same bytes
+        data[0] = (char)(random() % 3);
+        break;
+    }
+
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+  }
+
+  cout << "Parsed " << count << " mutated buffers" << endl;
+}
+
+static void runInput(istream& stream) {
+  vector<char> data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+  LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+int main(int argc, char* argv[]) {
+  if (argc == 3 && strcmp(argv[1], "--mutate") == 0) {
+    runMutations(atoi(argv[2]));
+    return 0;
+  }
+
+  if (argc == 1) {
+    runInput(cin);
+    return 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    ifstream file(argv[i], ios::binary);
+    if (!file) {
+      cerr << "Cannot open " << argv[i] << endl;
+      return 1;
+    }
+    runInput(file);
+  }
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * Stands in for VVGL.hpp so that the headers using GL can be built apart from VVISF. Only the declarations of GL are
+ * provided, and the functions are linked from the system's library.
+ */
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
@@ -0,0 +1,157 @@
+/**
+ * Tests of LRUCache under concurrent callers, checking that the factory of each key runs once however many threads ask
+ * for it, and that the values held outside of the cache survive any eviction.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LRUCache.hpp"
+
+using namespace std;
+
+static void check(bool condition, const char* message) {
+  if (!condition) {
+    cerr << "Check failed: " << message << endl;
+    abort();
+  }
+}
+
+struct Value {
+  int key;
+  size_t size;
+};
+
+static size_t sizeOfValue(const Value& value) {
+  return value.size;
+}
+
+static void testFactoryRunsOnce() {
+  static const int NumThreads = 16;
+  static const int NumKeys = 64;
+
+  // Large enough not to evict anything, so that every key is created exactly once
+  LRUCache<int, Value> cache(sizeOfValue, NumKeys * 100, 4);
+  vector<atomic<int>> numCreated(NumKeys);
+  atomic<bool> start{false};
+  vector<thread> threads;
+
+  for (int t = 0; t < NumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      while (!start) {
+        this_thread::yield();
+      }
+
+      for (int i = 0; i < NumKeys; i++) {
+        // Each thread walks the keys in a different order so that they collide at different points
+        int key = (i * 7 + t) % NumKeys;
+
+        auto value = cache.getOrCreate(key, [&numCreated, key]() {
+          numCreated[key]++;
+          this_thread::sleep_for(chrono::microseconds(50));
+          return make_shared<Value>(Value{key, 1});
+        });
+
+        check(value && value->key == key, "getOrCreate returns the value of the key");
+      }
+    });
+  }
+
+  start = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (int key = 0; key < NumKeys; key++) {
+    check(numCreated[key] == 1, "the factory of each key runs once");
+  }
+
+  check(cache.count() == NumKeys, "every key is cached");
+  check(cache.size() == NumKeys, "the running size sums up the values");
+}
+
+static void testPinnedNeverEvicted() {
+  static const int NumThreads = 8;
+  static const int NumIterations = 2000;
+  static const int NumPinned = 8;
+
+  // Only a few values fit in each shard, so that setting others keeps evicting
+  LRUCache<int, Value> cache(sizeOfValue, 40, 2);
+
+  vector<shared_ptr<Value>> pinned;
+  for (int key = 0; key < NumPinned; key++) {
+    pinned.push_back(make_shared<Value>(Value{key, 10}));
+    cache.set(key, pinned.back());
+  }
+
+  atomic<bool> start{false};
+  vector<thread> threads;
+
+  for (int t = 0; t < NumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      while (!start) {
+        this_thread::yield();
+      }
+
+      for (int i = 0; i < NumIterations; i++) {
+        int key = NumPinned + (t * NumIterations + i) % 256;
+
+        if (i % 3 == 0) {
+          cache.set(key, make_shared<Value>(Value{key, 10}));
+        } else {
+          cache.getOrCreate(key, [key]() { return make_shared<Value>(Value{key, 10}); });
+        }
+
+        auto value = cache.get(i % NumPinned);
+        check(value == pinned[i % NumPinned], "the pinned value stays cached");
+      }
+    });
+  }
+
+  start = true;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  cache.trim();
+
+  for (int key = 0; key < NumPinned; key++) {
+    check(cache.get(key) == pinned[key], "the pinned value stays cached after trimming");
+  }
+
+  // Unpinned, they're evicted down to the budget
+  pinned.clear();
+  cache.trim();
+
+  check(cache.size() <= 40, "trim fits the cache in the budget");
+}
+
+static void testLeastRecentlyUsedEvicted() {
+  LRUCache<int, Value> cache(sizeOfValue, 30, 1);
+
+  cache.set(0, make_shared<Value>(Value{0, 10}));
+  cache.set(1, make_shared<Value>(Value{1, 10}));
+  cache.set(2, make_shared<Value>(Value{2, 10}));
+
+  // Looking up 0 makes 1 the least recently used one
+  cache.get(0);
+  cache.set(3, make_shared<Value>(Value{3, 10}));
+
+  check(cache.get(0) != nullptr, "the looked up value is kept");
+  check(cache.get(1) == nullptr, "the least recently used value is evicted");
+  check(cache.get(2) != nullptr && cache.get(3) != nullptr, "the others are kept");
+}
+
+int main() {
+  testLeastRecentlyUsedEvicted();
+  testFactoryRunsOnce();
+  testPinnedNeverEvicted();
+
+  cout << "LRUCache tests passed" << endl;
+
+  return 0;
+}